@@ -63,24 +63,10 @@ void ClockModel::getPropertiesFinished(QDBusPendingCallWatcher *call)
     if (reply.isError()) {
         qCritical() << "ClockModel: getProperties: " << reply.error().name() << reply.error().message();
     } else {
-        QVariantMap properties = reply.value();
-
-        if (properties.contains(QLatin1String("Timezone"))) {
-            mTimezone = properties.value("Timezone").toString();
-            Q_EMIT timezoneChanged();
-        }
-        if (properties.contains(QLatin1String("TimezoneUpdates"))) {
-            mTimezoneUpdates = properties.value("TimezoneUpdates").toString();
-            Q_EMIT timezoneUpdatesChanged();
-        }
-        if (properties.contains(QLatin1String("TimeUpdates"))) {
-            mTimeUpdates = properties.value("TimeUpdates").toString();
-            Q_EMIT timeUpdatesChanged();
-        }
-        if (properties.contains(QLatin1String("Timeservers"))) {
-            mTimeservers = properties.value("Timeservers").toStringList();
-            Q_EMIT timeserversChanged();
-        }
+        const QVariantMap properties = reply.value();
+        QVariantMap::const_iterator it = properties.constBegin(), end = properties.constEnd();
+        for ( ; it != end; ++it)
+            updateProperty(it.key(), it.value());
     }
     call->deleteLater();
 }
@@ -96,18 +82,40 @@ void ClockModel::setPropertyFinished(QDBusPendingCallWatcher *call)
 
 void ClockModel::propertyChanged(const QString &name, const QDBusVariant &value)
 {
-    if (name == "Timezone") {
-        mTimezone = value.variant().toString();
+    updateProperty(name, value.variant());
+}
+
+int ClockModel::propertyId(const QString &name)
+{
+    static QHash<QString, int> ids;
+    if (ids.isEmpty()) { // init once
+        ids.insert(QLatin1String("Timezone"), TimezoneProperty);
+        ids.insert(QLatin1String("TimezoneUpdates"), TimezoneUpdatesProperty);
+        ids.insert(QLatin1String("TimeUpdates"), TimeUpdatesProperty);
+        ids.insert(QLatin1String("Timeservers"), TimeserversProperty);
+    }
+    return ids.value(name, -1);
+}
+
+void ClockModel::updateProperty(const QString &name, const QVariant &value)
+{
+    switch (propertyId(name)) {
+    case TimezoneProperty:
+        mTimezone = value.toString();
         Q_EMIT timezoneChanged();
-    } else if (name == "TimezoneUpdates") {
-        mTimezoneUpdates = value.variant().toString();
+        break;
+    case TimezoneUpdatesProperty:
+        mTimezoneUpdates = value.toString();
         Q_EMIT timezoneUpdatesChanged();
-    } else if (name == "TimeUpdates") {
-        mTimeUpdates = value.variant().toString();
+        break;
+    case TimeUpdatesProperty:
+        mTimeUpdates = value.toString();
         Q_EMIT timeUpdatesChanged();
-    } else if (name == "Timeservers") {
-        mTimeservers = value.variant().toStringList();
+        break;
+    case TimeserversProperty:
+        mTimeservers = value.toStringList();
         Q_EMIT timeserversChanged();
+        break;
     }
 }
 
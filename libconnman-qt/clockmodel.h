@@ -14,6 +14,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 #include <QtCore/QTime>
+#include <QtCore/QVariant>
 
 class QDBusPendingCallWatcher;
 class QDBusVariant;
@@ -67,6 +68,16 @@ private Q_SLOTS:
     void propertyChanged(const QString&, const QDBusVariant&);
 
 private:
+    enum PropertyId {
+        TimezoneProperty,
+        TimezoneUpdatesProperty,
+        TimeUpdatesProperty,
+        TimeserversProperty
+    };
+
+    static int propertyId(const QString &name);
+    void updateProperty(const QString &name, const QVariant &value);
+
     NetConnmanClockInterface *mClockProxy;
     QString mTimezone;
     QString mTimezoneUpdates;
@@ -8,6 +8,66 @@
  */
 
 #include "commondbustypes.h"
+#include "networkservice.h"
+
+namespace {
+
+QHash<QString, QString> createKnownKeys()
+{
+    static const char *const names[] = {
+        // Properties NetworkService does not decode, and the technology ones
+        "Immutable", "Provider", "Powered", "Connected", "Tethering",
+        "TetheringIdentifier", "TetheringPassphrase", "IdleTimeout",
+        // Keys of the nested dictionaries
+        "Method", "Address", "Netmask", "Gateway", "PrefixLength", "Privacy",
+        "URL", "Servers", "Excludes", "Host", "Domain", "Interface", "MTU"
+    };
+
+    const QStringList &properties = NetworkService::propertyNames();
+
+    QHash<QString, QString> keys;
+    keys.reserve(properties.count() + sizeof(names) / sizeof(names[0]));
+    Q_FOREACH (const QString &property, properties)
+        keys.insert(property, property);
+    for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        keys.insert(QLatin1String(names[i]), QLatin1String(names[i]));
+    return keys;
+}
+
+/*
+ * Reads an a{sv} dictionary. Known keys share one string each, nested
+ * dictionaries are decoded right away instead of being kept as
+ * QDBusArgument holding on to the whole message.
+ */
+void decodeDict(const QDBusArgument &argument, QVariantMap &map)
+{
+    static const QHash<QString, QString> knownKeys = createKnownKeys();
+    const int argumentType = qMetaTypeId<QDBusArgument>();
+
+    argument.beginMap();
+    while (!argument.atEnd()) {
+        QString key;
+        QDBusVariant value;
+        argument.beginMapEntry();
+        argument >> key >> value;
+        argument.endMapEntry();
+
+        if (value.variant().userType() == argumentType) {
+            const QDBusArgument nested = value.variant().value<QDBusArgument>();
+            // Other maps, like a{ss}, are left to whoever knows their type
+            if (nested.currentSignature() == QLatin1String("a{sv}")) {
+                QVariantMap dict;
+                decodeDict(nested, dict);
+                value.setVariant(dict);
+            }
+        }
+
+        map.insert(knownKeys.value(key, key), value.variant());
+    }
+    argument.endMap();
+}
+
+} // namespace
 
 // Marshall the ConnmanObject data into a D-Bus argument
 QDBusArgument &operator<<(QDBusArgument &argument, const ConnmanObject &obj)
@@ -22,7 +82,9 @@ QDBusArgument &operator<<(QDBusArgument &argument, const ConnmanObject &obj)
 const QDBusArgument &operator>>(const QDBusArgument &argument, ConnmanObject &obj)
 {
     argument.beginStructure();
-    argument >> obj.objpath >> obj.properties;
+    argument >> obj.objpath;
+    obj.properties.clear();
+    decodeDict(argument, obj.properties);
     argument.endStructure();
     return argument;
 }
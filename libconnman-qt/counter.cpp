@@ -7,11 +7,21 @@
  *
  */
 
-#include <QtDBus/QDBusConnection>
+#include <QTimer>
+#include <qmath.h>
 
 #include "counter.h"
+#include "counterhub.h"
 #include "networkmanager.h"
 
+namespace {
+
+const qreal RateTimeConstant = 5.0; // [s]
+const qreal RelativeRateThreshold = 0.05;
+// Without Usage for this many intervals a service is taken to be idle
+const int IdleIntervals = 3;
+
+}
 
 Counter::Counter(QObject *parent) :
     QObject(parent),
@@ -26,17 +36,17 @@ Counter::Counter(QObject *parent) :
     currentInterval(1),
     currentAccuracy(1024),
     shouldBeRunning(false),
-    registered(false)
+    registered(false),
+    m_rateTimer(new QTimer(this)),
+    m_rxRate(0),
+    m_txRate(0),
+    m_rxPeakRate(0),
+    m_txPeakRate(0),
+    m_rateThreshold(1024)
 {
-    QTime time = QTime::currentTime();
-    qsrand((uint)time.msec());
-    int randomValue = qrand();
-    //this needs to be unique so we can use more than one at a time with different processes
-    counterPath = "/ConnectivityCounter" + QString::number(randomValue);
-
-    new CounterAdaptor(this);
-    if (!QDBusConnection::systemBus().registerObject(counterPath, this))
-        qWarning("Could not register DBus object on %s", qPrintable(counterPath));
+    m_rateClock.start();
+    m_rateTimer->setSingleShot(true);
+    connect(m_rateTimer, SIGNAL(timeout()), this, SLOT(expireRates()));
 
     connect(m_manager, SIGNAL(availabilityChanged(bool)), this, SLOT(updateCounterAgent()));
 }
@@ -44,10 +54,11 @@ Counter::Counter(QObject *parent) :
 Counter::~Counter()
 {
     if (registered)
-        m_manager->unregisterCounter(counterPath);
+        CounterHub::instance()->removeCounter(this);
 }
 
-void Counter::serviceUsage(const QString &servicePath, const QVariantMap &counters,  bool roaming)
+void Counter::serviceUsage(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                           const QElapsedTimer &arrived)
 {
     Q_EMIT counterChanged(servicePath, counters, roaming);
 
@@ -88,14 +99,175 @@ void Counter::serviceUsage(const QString &servicePath, const QVariantMap &counte
         Q_EMIT bytesTransmittedChanged(txbytes);
     if (time != 0)
         Q_EMIT secondsOnlineChanged(time);
+
+    updateRate(servicePath, counters, roaming, arrived);
 }
 
 void Counter::release()
 {
     registered = false;
+    resetRates();
     Q_EMIT runningChanged(registered);
 }
 
+/*
+ * Exponentially weighted moving average of the bytes per second between
+ * Usage calls. A sample counts by how long it covers, taken from when
+ * connman reported it, so calls coming at irregular intervals or handed
+ * over late are averaged right.
+ */
+void Counter::updateRate(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                         const QElapsedTimer &arrived)
+{
+    const qint64 now = m_rateClock.msecsTo(arrived);
+    Rate &rate = m_rates[roaming][servicePath];
+
+    // Missing values did not change
+    const quint64 rx = counters.value("RX.Bytes", rate.rx).toULongLong();
+    const quint64 tx = counters.value("TX.Bytes", rate.tx).toULongLong();
+
+    if (rate.timestamp >= 0 && rx >= rate.rx && tx >= rate.tx) {
+        // Within the same millisecond the bytes go to the next sample
+        if (now == rate.timestamp)
+            return;
+
+        const qreal seconds = (now - rate.timestamp) / 1000.0;
+        const qreal weight = 1 - qExp(-seconds / RateTimeConstant);
+        rate.rxRate += weight * ((rx - rate.rx) / seconds - rate.rxRate);
+        rate.txRate += weight * ((tx - rate.tx) / seconds - rate.txRate);
+    }
+
+    rate.timestamp = now;
+    rate.rx = rx;
+    rate.tx = tx;
+
+    if (!m_rateTimer->isActive())
+        m_rateTimer->start(IdleIntervals * qMax<quint32>(currentInterval, 1) * 1000);
+
+    updateRateProperties();
+}
+
+void Counter::updateRateProperties()
+{
+    qreal rxRate = 0;
+    qreal txRate = 0;
+    for (int roaming = 0; roaming < 2; ++roaming) {
+        QHash<QString, Rate>::const_iterator it = m_rates[roaming].constBegin();
+        for ( ; it != m_rates[roaming].constEnd(); ++it) {
+            rxRate += it.value().rxRate;
+            txRate += it.value().txRate;
+        }
+    }
+
+    if (exceedsRateThreshold(rxRate, m_rxRate)) {
+        m_rxRate = rxRate;
+        Q_EMIT rxRateChanged(m_rxRate);
+        if (m_rxRate > m_rxPeakRate) {
+            m_rxPeakRate = m_rxRate;
+            Q_EMIT rxPeakRateChanged(m_rxPeakRate);
+        }
+    }
+
+    if (exceedsRateThreshold(txRate, m_txRate)) {
+        m_txRate = txRate;
+        Q_EMIT txRateChanged(m_txRate);
+        if (m_txRate > m_txPeakRate) {
+            m_txPeakRate = m_txRate;
+            Q_EMIT txPeakRateChanged(m_txPeakRate);
+        }
+    }
+}
+
+// Services which have gone quiet no longer add to the rates
+void Counter::expireRates()
+{
+    const qint64 idle = IdleIntervals * qMax<quint32>(currentInterval, 1) * 1000;
+    const qint64 now = m_rateClock.elapsed();
+    bool active = false;
+
+    for (int roaming = 0; roaming < 2; ++roaming) {
+        QHash<QString, Rate>::iterator it = m_rates[roaming].begin();
+        for ( ; it != m_rates[roaming].end(); ++it) {
+            if (now - it.value().timestamp >= idle) {
+                it.value().rxRate = 0;
+                it.value().txRate = 0;
+            } else if (it.value().rxRate != 0 || it.value().txRate != 0) {
+                active = true;
+            }
+        }
+    }
+
+    if (active)
+        m_rateTimer->start(idle);
+
+    updateRateProperties();
+}
+
+void Counter::resetRates()
+{
+    m_rates[0].clear();
+    m_rates[1].clear();
+    m_rateTimer->stop();
+    updateRateProperties();
+}
+
+// Going to or from idle is always worth it
+bool Counter::exceedsRateThreshold(qreal rate, qreal notified) const
+{
+    if (rate == notified)
+        return false;
+    if (rate == 0 || notified == 0)
+        return true;
+
+    return qAbs(rate - notified) >= qMax<qreal>(m_rateThreshold, notified * RelativeRateThreshold);
+}
+
+qreal Counter::rxRate() const
+{
+    return m_rxRate;
+}
+
+qreal Counter::txRate() const
+{
+    return m_txRate;
+}
+
+qreal Counter::rxPeakRate() const
+{
+    return m_rxPeakRate;
+}
+
+qreal Counter::txPeakRate() const
+{
+    return m_txPeakRate;
+}
+
+quint32 Counter::rateThreshold() const
+{
+    return m_rateThreshold;
+}
+
+void Counter::setRateThreshold(quint32 threshold)
+{
+    if (m_rateThreshold == threshold)
+        return;
+
+    m_rateThreshold = threshold;
+    Q_EMIT rateThresholdChanged(m_rateThreshold);
+}
+
+void Counter::resetPeakRates()
+{
+    if (m_rxPeakRate != m_rxRate) {
+        m_rxPeakRate = m_rxRate;
+        Q_EMIT rxPeakRateChanged(m_rxPeakRate);
+    }
+    if (m_txPeakRate != m_txRate) {
+        m_txPeakRate = m_txRate;
+        Q_EMIT txPeakRateChanged(m_txPeakRate);
+    }
+}
+
 bool Counter::roaming() const
 {
     return roamingEnabled;
@@ -132,8 +304,8 @@ quint32 Counter::secondsOnline() const
  *The accuracy value is in kilo-bytes. It defines
             the update threshold.
 
-Changing the accuracy will reset the counters, as it will
-need to be re registered from the manager.
+Changing the accuracy re-registers the counter at the next
+event loop turn, together with other changes made until then.
 */
 void Counter::setAccuracy(quint32 accuracy)
 {
@@ -152,8 +324,8 @@ quint32 Counter::accuracy() const
 
 /*
  *The interval value is in seconds.
-Changing the accuracy will reset the counters, as it will
-need to be re registered from the manager.
+Changing the interval re-registers the counter at the next
+event loop turn, together with other changes made until then.
 */
 void Counter::setInterval(quint32 interval)
 {
@@ -181,29 +353,23 @@ void Counter::setRunning(bool on)
 
 void Counter::updateCounterAgent()
 {
-    if (!m_manager->isAvailable()) {
+    CounterHub *hub = CounterHub::instance();
+
+    if (!m_manager->isAvailable() || !shouldBeRunning) {
         if (registered) {
+            hub->removeCounter(this);
             registered = false;
+            resetRates();
             Q_EMIT runningChanged(registered);
         }
         return;
     }
 
-    if (registered) {
-        m_manager->unregisterCounter(counterPath);
-        if (!shouldBeRunning) {
-            registered = false;
-            Q_EMIT runningChanged(registered);
-            return;
-        }
-    }
-
-    if (shouldBeRunning) {
-        m_manager->registerCounter(counterPath, currentAccuracy, currentInterval);
-        if (!registered) {
-            registered = true;
-            Q_EMIT runningChanged(registered);
-        }
+    // Also brings a changed accuracy or interval to the registration
+    hub->addCounter(this);
+    if (!registered) {
+        registered = true;
+        Q_EMIT runningChanged(registered);
     }
 }
 
@@ -211,36 +377,3 @@ bool Counter::running() const
 {
     return registered;
 }
-
-/*
- *This is the dbus adaptor to the connman interface
- **/
-CounterAdaptor::CounterAdaptor(Counter* parent)
-  : QDBusAbstractAdaptor(parent),
-    m_counter(parent)
-{
-}
-
-CounterAdaptor::~CounterAdaptor()
-{
-}
-
-void CounterAdaptor::Release()
-{
-     m_counter->release();
-}
-
-void CounterAdaptor::Usage(const QDBusObjectPath &service_path,
-                           const QVariantMap &home,
-                           const QVariantMap &roaming)
-{
-    if (!home.isEmpty()) {
-        // home
-        m_counter->serviceUsage(service_path.path(), home, false);
-    }
-    if (!roaming.isEmpty()) {
-        //roaming
-        m_counter->serviceUsage(service_path.path(), roaming, true);
-    }
-}
-
@@ -11,17 +11,17 @@
 #define COUNTER_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QVariantMap>
-#include <QtDBus/QDBusAbstractAdaptor>
-#include <QtDBus/QDBusObjectPath>
 
 class NetworkManager;
+class QTimer;
 
 /*
- * Proxy class for interface net.connman.Counter
+ * Usage reported by connman for the services. All Counters of a process
+ * share one registration, see CounterHub.
  */
-//  static const char counterPath[] = "/ConnectivityCounter";
-
 class Counter : public QObject
 {
     Q_OBJECT
@@ -35,6 +35,12 @@ class Counter : public QObject
 
     Q_PROPERTY(bool running READ running WRITE setRunning NOTIFY runningChanged)
 
+    Q_PROPERTY(qreal rxRate READ rxRate NOTIFY rxRateChanged)
+    Q_PROPERTY(qreal txRate READ txRate NOTIFY txRateChanged)
+    Q_PROPERTY(qreal rxPeakRate READ rxPeakRate NOTIFY rxPeakRateChanged)
+    Q_PROPERTY(qreal txPeakRate READ txPeakRate NOTIFY txPeakRateChanged)
+    Q_PROPERTY(quint32 rateThreshold READ rateThreshold WRITE setRateThreshold NOTIFY rateThresholdChanged)
+
     Q_DISABLE_COPY(Counter)
 public:
       explicit Counter(QObject *parent = 0);
@@ -56,6 +62,18 @@ public:
     bool running() const;
     void setRunning(bool on);
 
+    /* Smoothed bytes per second over all services */
+    qreal rxRate() const;
+    qreal txRate() const;
+    qreal rxPeakRate() const;
+    qreal txPeakRate() const;
+
+    /* The least change in bytes per second worth notifying */
+    quint32 rateThreshold() const;
+    void setRateThreshold(quint32 threshold);
+
+    Q_INVOKABLE void resetPeakRates();
+
 Q_SIGNALS:
     void counterChanged(const QString &servicePath, const QVariantMap &counters, bool roaming);
     void bytesReceivedChanged(quint64 bytesRx);
@@ -65,17 +83,40 @@ Q_SIGNALS:
     void accuracyChanged(quint32 accuracy);
     void intervalChanged(quint32 interval);
     void runningChanged(bool running);
+    void rxRateChanged(qreal rate);
+    void txRateChanged(qreal rate);
+    void rxPeakRateChanged(qreal rate);
+    void txPeakRateChanged(qreal rate);
+    void rateThresholdChanged(quint32 threshold);
 
 private Q_SLOTS:
     void updateCounterAgent();
+    void expireRates();
 
 private:
+    struct Rate
+    {
+        Rate() : timestamp(-1), rx(0), tx(0), rxRate(0), txRate(0) {}
+
+        qint64 timestamp; // [ms] on m_rateClock
+        quint64 rx;
+        quint64 tx;
+        qreal rxRate;
+        qreal txRate;
+    };
+
     NetworkManager* m_manager;
 
-    friend class CounterAdaptor;
+    friend class CounterHub;
 
-    void serviceUsage(const QString &servicePath, const QVariantMap &counters,  bool roaming);
+    void serviceUsage(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                      const QElapsedTimer &arrived);
     void release();
+    void updateRate(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                    const QElapsedTimer &arrived);
+    void updateRateProperties();
+    void resetRates();
+    bool exceedsRateThreshold(qreal rate, qreal notified) const;
 
     quint64 bytesInHome;
     quint64 bytesOutHome;
@@ -89,28 +130,19 @@ private:
     quint32 currentInterval;
     quint32 currentAccuracy;
 
-    QString counterPath;
     bool shouldBeRunning;
 
     bool registered;
-};
 
-class CounterAdaptor : public QDBusAbstractAdaptor
-{
-    Q_OBJECT
-    Q_CLASSINFO("D-Bus Interface", "net.connman.Counter")
-
-public:
-    explicit CounterAdaptor(Counter *parent);
-    virtual ~CounterAdaptor();
-
-public Q_SLOTS:
-    void Release();
-    void Usage(const QDBusObjectPath &service_path,
-                                const QVariantMap &home,
-                                const QVariantMap &roaming);
-
-private:
-    Counter *m_counter;
+    // Home and roaming, by service path
+    QHash<QString, Rate> m_rates[2];
+    QElapsedTimer m_rateClock;
+    QTimer *m_rateTimer;
+    qreal m_rxRate;
+    qreal m_txRate;
+    qreal m_rxPeakRate;
+    qreal m_txPeakRate;
+    quint32 m_rateThreshold;
 };
+
 #endif // COUNTER_H
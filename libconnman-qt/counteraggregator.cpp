@@ -0,0 +1,345 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "counteraggregator.h"
+#include "counter.h"
+#include "usagestore.h"
+#include "counterusage_p.h"
+
+using namespace CounterUsage;
+
+namespace {
+
+enum {
+    MinuteBuckets = 60,
+    HourBuckets = 48,
+    DayBuckets = 62
+};
+
+struct Bucket {
+    Bucket() : rx(0), tx(0), seconds(0) {}
+
+    quint64 rx;
+    quint64 tx;
+    quint64 seconds;
+};
+
+/*
+ * Buckets of equal length, bucket n covering [n * length, (n + 1) * length)
+ * in msecs since the epoch moved by offset, the local time of the
+ * aggregator. head is the newest bucket, the ring reaches back size - 1
+ * buckets from it.
+ */
+struct Ring {
+    Ring(Bucket *buckets, int size, qint64 length, qint64 offset)
+        : buckets(buckets), size(size), length(length), offset(offset), head(-1) {}
+
+    qint64 first() const { return head - size + 1; }
+    qint64 indexAt(qint64 timestamp) const { return (timestamp + offset) / length; }
+    qint64 start(qint64 index) const { return index * length - offset; }
+
+    void add(qint64 timestamp, const Bucket &delta)
+    {
+        const qint64 index = indexAt(timestamp);
+        if (index > head) {
+            // Clear the buckets being skipped over
+            const qint64 steps = qMin<qint64>(index - head, size);
+            for (qint64 i = index - steps + 1; i <= index; ++i)
+                buckets[i % size] = Bucket();
+            head = index;
+        } else if (index < first()) {
+            return;
+        }
+
+        Bucket &bucket = buckets[index % size];
+        bucket.rx += delta.rx;
+        bucket.tx += delta.tx;
+        bucket.seconds += delta.seconds;
+    }
+
+    // Buckets touching [from, to) count in full
+    void sum(qint64 from, qint64 to, Bucket *total) const
+    {
+        const qint64 last = qMin(head, indexAt(to - 1));
+        for (qint64 i = qMax(first(), indexAt(from)); i <= last; ++i) {
+            const Bucket &bucket = buckets[i % size];
+            total->rx += bucket.rx;
+            total->tx += bucket.tx;
+            total->seconds += bucket.seconds;
+        }
+    }
+
+    Bucket *buckets;
+    int size;
+    qint64 length;
+    qint64 offset;
+    qint64 head;
+};
+
+quint64 delta(const QVariantMap &counters, const QString &key, quint64 *baseline)
+{
+    QVariantMap::const_iterator it = counters.constFind(key);
+    if (it == counters.constEnd())
+        return 0;
+
+    const quint64 value = it.value().toULongLong();
+    // Below the baseline the counter was reset and counts up from zero again
+    const quint64 used = value >= *baseline ? value - *baseline : value;
+    *baseline = value;
+    return used;
+}
+
+}
+
+struct CounterAggregator::Series
+{
+    explicit Series(qint64 offset)
+        : minutes(minuteBuckets, MinuteBuckets, MinuteLength, offset),
+          hours(hourBuckets, HourBuckets, HourLength, offset),
+          days(dayBuckets, DayBuckets, DayLength, offset)
+    {
+        hasBaseline[0] = hasBaseline[1] = false;
+    }
+
+    Bucket minuteBuckets[MinuteBuckets];
+    Bucket hourBuckets[HourBuckets];
+    Bucket dayBuckets[DayBuckets];
+    Ring minutes;
+    Ring hours;
+    Ring days;
+
+    // Last absolute values, home and roaming
+    Bucket baseline[2];
+    bool hasBaseline[2];
+
+private:
+    Q_DISABLE_COPY(Series)
+};
+
+CounterAggregator::CounterAggregator(QObject *parent)
+    : QObject(parent),
+      m_utcOffset(localUtcOffset())
+{
+}
+
+CounterAggregator::~CounterAggregator()
+{
+    qDeleteAll(m_series);
+}
+
+Counter *CounterAggregator::counter() const
+{
+    return m_counter;
+}
+
+void CounterAggregator::setCounter(Counter *counter)
+{
+    if (m_counter == counter)
+        return;
+
+    if (m_counter) {
+        disconnect(m_counter, SIGNAL(counterChanged(QString,QVariantMap,bool)),
+                   this, SLOT(addUsage(QString,QVariantMap,bool)));
+    }
+
+    m_counter = counter;
+
+    if (m_counter) {
+        connect(m_counter, SIGNAL(counterChanged(QString,QVariantMap,bool)),
+                this, SLOT(addUsage(QString,QVariantMap,bool)));
+    }
+
+    Q_EMIT counterChanged(m_counter);
+}
+
+int CounterAggregator::utcOffset() const
+{
+    return m_utcOffset;
+}
+
+// Buckets filled so far would not line up with the new ones
+void CounterAggregator::setUtcOffset(int utcOffset)
+{
+    if (m_utcOffset == utcOffset)
+        return;
+
+    clear();
+    m_utcOffset = utcOffset;
+    Q_EMIT utcOffsetChanged(m_utcOffset);
+}
+
+QStringList CounterAggregator::services() const
+{
+    return m_series.keys();
+}
+
+void CounterAggregator::addUsage(const QString &servicePath, const QVariantMap &counters,
+                                 bool roaming)
+{
+    addUsage(servicePath, counters, roaming, QDateTime::currentMSecsSinceEpoch());
+}
+
+void CounterAggregator::addUsage(const QString &servicePath, const QVariantMap &counters,
+                                 bool roaming, qint64 timestamp)
+{
+    Series *series = m_series.value(servicePath);
+    if (!series) {
+        series = new Series(qint64(m_utcOffset) * 1000);
+        m_series.insert(servicePath, series);
+        addUsage(series, servicePath, counters, roaming, timestamp);
+        Q_EMIT servicesChanged();
+        return;
+    }
+
+    addUsage(series, servicePath, counters, roaming, timestamp);
+}
+
+void CounterAggregator::addUsage(Series *series, const QString &servicePath,
+                                 const QVariantMap &counters, bool roaming, qint64 timestamp)
+{
+    Bucket &baseline = series->baseline[roaming];
+
+    // The first values only tell where this service's counters stand
+    if (!series->hasBaseline[roaming]) {
+        series->hasBaseline[roaming] = true;
+        baseline.rx = counters.value(RxBytesKey).toULongLong();
+        baseline.tx = counters.value(TxBytesKey).toULongLong();
+        baseline.seconds = counters.value(TimeKey).toULongLong();
+        return;
+    }
+
+    Bucket used;
+    used.rx = delta(counters, RxBytesKey, &baseline.rx);
+    used.tx = delta(counters, TxBytesKey, &baseline.tx);
+    used.seconds = delta(counters, TimeKey, &baseline.seconds);
+    if (!used.rx && !used.tx && !used.seconds)
+        return;
+
+    series->minutes.add(timestamp, used);
+    series->hours.add(timestamp, used);
+    series->days.add(timestamp, used);
+
+    Q_EMIT usageChanged(servicePath);
+}
+
+QVariantMap CounterAggregator::usage(const QString &servicePath,
+                                     const QDateTime &from, const QDateTime &to) const
+{
+    QVariantMap totals;
+    sumUsage(m_series.value(servicePath), from.toMSecsSinceEpoch(), to.toMSecsSinceEpoch(),
+             &totals);
+    return totals;
+}
+
+QVariantMap CounterAggregator::technologyUsage(const QString &type,
+                                               const QDateTime &from, const QDateTime &to) const
+{
+    QVariantMap totals;
+    QHash<QString, Series *>::const_iterator it = m_series.constBegin();
+    for ( ; it != m_series.constEnd(); ++it) {
+        if (serviceType(it.key()) == type)
+            sumUsage(it.value(), from.toMSecsSinceEpoch(), to.toMSecsSinceEpoch(), &totals);
+    }
+    return totals;
+}
+
+QVariantList CounterAggregator::history(const QString &servicePath, Resolution resolution) const
+{
+    QVariantList intervals;
+
+    const Series *series = m_series.value(servicePath);
+    if (!series)
+        return intervals;
+
+    const Ring &ring = resolution == Minutes ? series->minutes
+                     : resolution == Hours ? series->hours
+                     : series->days;
+    if (ring.head < 0)
+        return intervals;
+
+    for (qint64 i = qMax<qint64>(ring.first(), 0); i <= ring.head; ++i) {
+        const Bucket &bucket = ring.buckets[i % ring.size];
+        QVariantMap interval;
+        interval.insert(QLatin1String("Start"),
+                        QDateTime::fromMSecsSinceEpoch(ring.start(i)));
+        interval.insert(RxBytesKey, bucket.rx);
+        interval.insert(TxBytesKey, bucket.tx);
+        interval.insert(TimeKey, bucket.seconds);
+        intervals.append(interval);
+    }
+    return intervals;
+}
+
+void CounterAggregator::load(UsageStore *store)
+{
+    if (!store)
+        return;
+
+    QVariantMap counters;
+    for (int i = 0; i < store->count(); ++i) {
+        const UsageStore::Sample sample = store->sample(i);
+        counters.insert(RxBytesKey, sample.rxBytes);
+        counters.insert(TxBytesKey, sample.txBytes);
+        counters.insert(TimeKey, sample.seconds);
+        addUsage(sample.servicePath, counters, sample.roaming, sample.timestamp);
+    }
+}
+
+void CounterAggregator::clear()
+{
+    if (m_series.isEmpty())
+        return;
+
+    qDeleteAll(m_series);
+    m_series.clear();
+    Q_EMIT servicesChanged();
+}
+
+// QDateTime of Qt 4 has no offsetFromUtc()
+int CounterAggregator::localUtcOffset()
+{
+    const QDateTime local = QDateTime::currentDateTime();
+    QDateTime utc = local.toUTC();
+    utc.setTimeSpec(Qt::LocalTime);
+    return utc.secsTo(local);
+}
+
+// connman names services <type>_<identifier>
+QString CounterAggregator::serviceType(const QString &servicePath)
+{
+    const int start = servicePath.lastIndexOf(QLatin1Char('/')) + 1;
+    const int end = servicePath.indexOf(QLatin1Char('_'), start);
+    return servicePath.mid(start, end < 0 ? -1 : end - start);
+}
+
+/*
+ * Adds up the finest ring which reaches back to the start of the window,
+ * or the day ring for windows starting before any ring does.
+ */
+void CounterAggregator::sumUsage(const Series *series, qint64 from, qint64 to,
+                                 QVariantMap *totals) const
+{
+    Bucket total;
+    total.rx = totals->value(RxBytesKey).toULongLong();
+    total.tx = totals->value(TxBytesKey).toULongLong();
+    total.seconds = totals->value(TimeKey).toULongLong();
+
+    if (series && from < to) {
+        const Ring *ring = &series->days;
+        if (from >= series->minutes.start(series->minutes.first()))
+            ring = &series->minutes;
+        else if (from >= series->hours.start(series->hours.first()))
+            ring = &series->hours;
+        ring->sum(from, to, &total);
+    }
+
+    totals->insert(RxBytesKey, total.rx);
+    totals->insert(TxBytesKey, total.tx);
+    totals->insert(TimeKey, total.seconds);
+}
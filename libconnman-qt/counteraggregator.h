@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef COUNTERAGGREGATOR_H
+#define COUNTERAGGREGATOR_H
+
+#include <QObject>
+#include <QPointer>
+#include <QDateTime>
+#include <QHash>
+#include <QStringList>
+#include <QVariantMap>
+
+class Counter;
+class UsageStore;
+
+/*
+ * Turns the absolute per service values reported by a Counter into usage
+ * time series. Each service keeps what was used per minute for the last
+ * hour, per hour for the last two days and per day for the last two
+ * months, in fixed size rings. Counters going backwards, as they do when
+ * connman resets them, start a new baseline instead of losing usage.
+ *
+ * Hours and days start on the local clock, utcOffset seconds east of UTC.
+ * It is taken from the time zone when the aggregator is created and kept
+ * from there on, so a daylight saving change does not split a day. Setting
+ * it clears the usage collected so far.
+ */
+class CounterAggregator : public QObject
+{
+    Q_OBJECT
+
+    Q_ENUMS(Resolution)
+    Q_PROPERTY(Counter *counter READ counter WRITE setCounter NOTIFY counterChanged)
+    Q_PROPERTY(int utcOffset READ utcOffset WRITE setUtcOffset NOTIFY utcOffsetChanged)
+    Q_PROPERTY(QStringList services READ services NOTIFY servicesChanged)
+
+    Q_DISABLE_COPY(CounterAggregator)
+
+public:
+    enum Resolution {
+        Minutes,
+        Hours,
+        Days
+    };
+
+    explicit CounterAggregator(QObject *parent = 0);
+    virtual ~CounterAggregator();
+
+    Counter *counter() const;
+    void setCounter(Counter *counter);
+
+    int utcOffset() const;
+    void setUtcOffset(int utcOffset);
+
+    QStringList services() const;
+
+    /* Totals as RX.Bytes, TX.Bytes and Time, at the resolution covering the window */
+    Q_INVOKABLE QVariantMap usage(const QString &servicePath,
+                                  const QDateTime &from, const QDateTime &to) const;
+    Q_INVOKABLE QVariantMap technologyUsage(const QString &type,
+                                            const QDateTime &from, const QDateTime &to) const;
+    /* Oldest first, one map per interval with its start as "Start" */
+    Q_INVOKABLE QVariantList history(const QString &servicePath, Resolution resolution) const;
+
+    /* Replays the samples kept by store, meant for an aggregator just created or cleared */
+    Q_INVOKABLE void load(UsageStore *store);
+
+    void addUsage(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                  qint64 timestamp);
+
+public Q_SLOTS:
+    void addUsage(const QString &servicePath, const QVariantMap &counters, bool roaming);
+    void clear();
+
+Q_SIGNALS:
+    void counterChanged(Counter *counter);
+    void utcOffsetChanged(int utcOffset);
+    void servicesChanged();
+    void usageChanged(const QString &servicePath);
+
+private:
+    struct Series;
+
+    static int localUtcOffset();
+    static QString serviceType(const QString &servicePath);
+    void addUsage(Series *series, const QString &servicePath, const QVariantMap &counters,
+                  bool roaming, qint64 timestamp);
+    void sumUsage(const Series *series, qint64 from, qint64 to, QVariantMap *totals) const;
+
+    QPointer<Counter> m_counter;
+    int m_utcOffset; // [s]
+    QHash<QString, Series *> m_series;
+};
+
+#endif // COUNTERAGGREGATOR_H
@@ -0,0 +1,363 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include <QCoreApplication>
+#include <QSet>
+#include <QTimer>
+#include <QtDBus/QDBusConnection>
+
+#include "counterhub.h"
+#include "counter.h"
+#include "networkmanager.h"
+#include "stringpool.h"
+
+static CounterHub *staticInstance = NULL;
+
+struct CounterHub::Subscriber
+{
+    // What was last handed over for a service, home and roaming
+    struct Delivery
+    {
+        QElapsedTimer delivered[2];
+        QVariantMap pending[2];
+        // When connman reported the newest of the pending values
+        QElapsedTimer arrived[2];
+    };
+
+    Subscriber(Counter *counter, QTimer *flushTimer)
+        : counter(counter), flushTimer(flushTimer) {}
+    ~Subscriber() { delete flushTimer; }
+
+    Counter *counter;
+    QHash<QString, Delivery> deliveries;
+    // Hands over what is held back when no Usage comes to do it
+    QTimer *flushTimer;
+};
+
+// Raw values last reported for a service and what is added to them
+struct CounterHub::Totals
+{
+    QVariantMap last;
+    QHash<QString, quint64> offsets;
+    // Keys not reported again since the re-registration
+    QSet<QString> reregistered;
+};
+
+CounterHub *CounterHub::instance()
+{
+    if (!staticInstance)
+        staticInstance = new CounterHub;
+
+    return staticInstance;
+}
+
+CounterHub::CounterHub(QObject *parent)
+    : QObject(parent),
+      m_manager(NetworkManagerFactory::createInstance()),
+      m_path(QString("/ConnectivityCounter%1").arg(QCoreApplication::applicationPid())),
+      m_registrationPending(false),
+      m_registered(false),
+      m_accuracy(0),
+      m_interval(0)
+{
+    new CounterAdaptor(this);
+    if (!QDBusConnection::systemBus().registerObject(m_path, this))
+        qWarning("Could not register DBus object on %s", qPrintable(m_path));
+
+    connect(m_manager, SIGNAL(availabilityChanged(bool)), this, SLOT(updateRegistration()));
+}
+
+CounterHub::~CounterHub()
+{
+    qDeleteAll(m_subscribers);
+    clearTotals();
+}
+
+void CounterHub::addCounter(Counter *counter)
+{
+    if (indexOf(counter) < 0) {
+        QTimer *flushTimer = new QTimer(this);
+        flushTimer->setSingleShot(true);
+        connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushPending()));
+        m_subscribers.append(new Subscriber(counter, flushTimer));
+    }
+
+    scheduleRegistration();
+}
+
+void CounterHub::removeCounter(Counter *counter)
+{
+    const int index = indexOf(counter);
+    if (index < 0)
+        return;
+
+    delete m_subscribers.takeAt(index);
+
+    // Nothing to batch once the last one is gone
+    if (m_subscribers.isEmpty())
+        updateRegistration();
+    else
+        scheduleRegistration();
+}
+
+QString CounterHub::path() const
+{
+    return m_path;
+}
+
+bool CounterHub::isRegistered() const
+{
+    return m_registered;
+}
+
+quint32 CounterHub::accuracy() const
+{
+    return m_accuracy;
+}
+
+quint32 CounterHub::interval() const
+{
+    return m_interval;
+}
+
+void CounterHub::updateRegistration()
+{
+    m_registrationPending = false;
+
+    if (!m_manager->isAvailable()) {
+        // The registration went away with connman
+        m_registered = false;
+        clearTotals();
+        return;
+    }
+
+    quint32 accuracy = 0;
+    quint32 interval = 0;
+    for (int i = 0; i < m_subscribers.count(); ++i) {
+        const Counter *counter = m_subscribers.at(i)->counter;
+        accuracy = i == 0 ? counter->accuracy() : qMin(accuracy, counter->accuracy());
+        interval = i == 0 ? counter->interval() : qMin(interval, counter->interval());
+    }
+
+    const bool wanted = !m_subscribers.isEmpty();
+    if (m_registered == wanted && m_accuracy == accuracy && m_interval == interval)
+        return;
+
+    if (m_registered)
+        m_manager->unregisterCounter(m_path);
+
+    m_registered = wanted;
+    m_accuracy = accuracy;
+    m_interval = interval;
+
+    if (!m_registered) {
+        clearTotals();
+    } else {
+        for (int roaming = 0; roaming < 2; ++roaming) {
+            Q_FOREACH (Totals *totals, m_totals[roaming])
+                totals->reregistered = QSet<QString>::fromList(totals->last.keys());
+        }
+    }
+
+    if (m_registered)
+        m_manager->registerCounter(m_path, m_accuracy, m_interval);
+}
+
+// Counters changing their accuracy and interval in a row register once
+void CounterHub::scheduleRegistration()
+{
+    if (m_registrationPending)
+        return;
+
+    m_registrationPending = true;
+    QMetaObject::invokeMethod(this, "updateRegistration", Qt::QueuedConnection);
+}
+
+int CounterHub::indexOf(Counter *counter) const
+{
+    for (int i = 0; i < m_subscribers.count(); ++i) {
+        if (m_subscribers.at(i)->counter == counter)
+            return i;
+    }
+    return -1;
+}
+
+void CounterHub::serviceUsage(const QString &servicePath, const QVariantMap &counters,
+                              bool roaming)
+{
+    QElapsedTimer arrived;
+    arrived.start();
+
+    const QString path = StringPool::intern(servicePath);
+    const QVariantMap totals = carryTotals(path, counters, roaming);
+
+    // Counters may be stopped or deleted by the signals they emit
+    const QList<Subscriber *> subscribers = m_subscribers;
+    Q_FOREACH (Subscriber *subscriber, subscribers) {
+        if (m_subscribers.contains(subscriber))
+            deliver(subscriber, path, totals, roaming, arrived);
+    }
+}
+
+/*
+ * A value lower than before, the first time a key is reported after a
+ * re-registration, means connman started over. What was reached before is
+ * then added to it from there on.
+ */
+QVariantMap CounterHub::carryTotals(const QString &servicePath, const QVariantMap &counters,
+                                    bool roaming)
+{
+    Totals *&totals = m_totals[roaming][servicePath];
+    if (!totals)
+        totals = new Totals;
+
+    QVariantMap::const_iterator it = counters.constBegin();
+    for ( ; it != counters.constEnd(); ++it) {
+        if (totals->reregistered.remove(it.key())) {
+            const quint64 last = totals->last.value(it.key()).toULongLong();
+            if (it.value().toULongLong() < last)
+                totals->offsets[it.key()] += last;
+        }
+        totals->last.insert(it.key(), it.value());
+    }
+
+    if (totals->offsets.isEmpty())
+        return counters;
+
+    QVariantMap carried(counters);
+    QHash<QString, quint64>::const_iterator offset = totals->offsets.constBegin();
+    for ( ; offset != totals->offsets.constEnd(); ++offset) {
+        QVariantMap::iterator value = carried.find(offset.key());
+        if (value != carried.end())
+            value.value() = value.value().toULongLong() + offset.value();
+    }
+    return carried;
+}
+
+void CounterHub::clearTotals()
+{
+    for (int roaming = 0; roaming < 2; ++roaming) {
+        qDeleteAll(m_totals[roaming]);
+        m_totals[roaming].clear();
+    }
+}
+
+/*
+ * Values held back from a Counter are merged into the next ones it gets,
+ * in case connman left out what did not change.
+ */
+void CounterHub::deliver(Subscriber *subscriber, const QString &servicePath,
+                         const QVariantMap &counters, bool roaming,
+                         const QElapsedTimer &arrived)
+{
+    Subscriber::Delivery &delivery = subscriber->deliveries[servicePath];
+    QElapsedTimer &delivered = delivery.delivered[roaming];
+    QVariantMap &pending = delivery.pending[roaming];
+    delivery.arrived[roaming] = arrived;
+
+    if (pending.isEmpty()) {
+        pending = counters;
+    } else {
+        QVariantMap::const_iterator it = counters.constBegin();
+        for ( ; it != counters.constEnd(); ++it)
+            pending.insert(it.key(), it.value());
+    }
+
+    // Usage arriving up to half a registered interval early still counts
+    const quint32 interval = subscriber->counter->interval();
+    if (delivered.isValid() && interval > m_interval
+            && delivered.elapsed() + m_interval * 500 < qint64(interval) * 1000) {
+        // Usage connman is due to send by then hands them over first
+        if (!subscriber->flushTimer->isActive()) {
+            subscriber->flushTimer->start(
+                    int(qint64(interval) * 1000 - delivered.elapsed() + m_interval * 1000));
+        }
+        return;
+    }
+
+    handOver(subscriber, servicePath, roaming);
+}
+
+void CounterHub::handOver(Subscriber *subscriber, const QString &servicePath, bool roaming)
+{
+    Subscriber::Delivery &delivery = subscriber->deliveries[servicePath];
+    delivery.delivered[roaming].start();
+    const QVariantMap values = delivery.pending[roaming];
+    delivery.pending[roaming].clear();
+    subscriber->counter->serviceUsage(servicePath, values, roaming,
+                                      delivery.arrived[roaming]);
+}
+
+void CounterHub::flushPending()
+{
+    Subscriber *subscriber = NULL;
+    Q_FOREACH (Subscriber *candidate, m_subscribers) {
+        if (candidate->flushTimer == sender())
+            subscriber = candidate;
+    }
+    if (!subscriber)
+        return;
+
+    const QStringList servicePaths = subscriber->deliveries.keys();
+    Q_FOREACH (const QString &servicePath, servicePaths) {
+        for (int roaming = 0; roaming < 2; ++roaming) {
+            // Counters may be stopped or deleted by the signals they emit
+            if (!m_subscribers.contains(subscriber))
+                return;
+            if (!subscriber->deliveries.value(servicePath).pending[roaming].isEmpty())
+                handOver(subscriber, servicePath, roaming);
+        }
+    }
+}
+
+void CounterHub::release()
+{
+    m_registered = false;
+    clearTotals();
+
+    const QList<Subscriber *> subscribers = m_subscribers;
+    m_subscribers.clear();
+    Q_FOREACH (Subscriber *subscriber, subscribers) {
+        Counter *counter = subscriber->counter;
+        delete subscriber;
+        counter->release();
+    }
+}
+
+/*
+ *This is the dbus adaptor to the connman interface
+ **/
+CounterAdaptor::CounterAdaptor(CounterHub *parent)
+  : QDBusAbstractAdaptor(parent),
+    m_hub(parent)
+{
+}
+
+CounterAdaptor::~CounterAdaptor()
+{
+}
+
+void CounterAdaptor::Release()
+{
+     m_hub->release();
+}
+
+void CounterAdaptor::Usage(const QDBusObjectPath &service_path,
+                           const QVariantMap &home,
+                           const QVariantMap &roaming)
+{
+    if (!home.isEmpty()) {
+        // home
+        m_hub->serviceUsage(service_path.path(), home, false);
+    }
+    if (!roaming.isEmpty()) {
+        //roaming
+        m_hub->serviceUsage(service_path.path(), roaming, true);
+    }
+}
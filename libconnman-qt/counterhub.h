@@ -0,0 +1,104 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef COUNTERHUB_H
+#define COUNTERHUB_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+#include <QtDBus/QDBusAbstractAdaptor>
+#include <QtDBus/QDBusObjectPath>
+
+class Counter;
+class NetworkManager;
+
+/*
+ * The one net.connman.Counter object of the process, shared by all running
+ * Counters. It is registered with the finest accuracy and the shortest
+ * interval any of them asks for, and each Counter is handed the usage no
+ * more often than its own interval. What is held back from a Counter is
+ * handed over at the end of its interval even if no more Usage comes.
+ *
+ * Registration changes are made once per event loop turn, and values
+ * connman starts over from after a re-registration continue from the
+ * totals reached before it.
+ */
+class CounterHub : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(CounterHub)
+
+public:
+    static CounterHub *instance();
+
+    void addCounter(Counter *counter);
+    void removeCounter(Counter *counter);
+
+    QString path() const;
+    bool isRegistered() const;
+    quint32 accuracy() const;
+    quint32 interval() const;
+
+private Q_SLOTS:
+    void updateRegistration();
+    void flushPending();
+
+private:
+    struct Subscriber;
+    struct Totals;
+
+    explicit CounterHub(QObject *parent = 0);
+    virtual ~CounterHub();
+
+    friend class CounterAdaptor;
+
+    int indexOf(Counter *counter) const;
+    void scheduleRegistration();
+    QVariantMap carryTotals(const QString &servicePath, const QVariantMap &counters,
+                            bool roaming);
+    void clearTotals();
+    void serviceUsage(const QString &servicePath, const QVariantMap &counters, bool roaming);
+    void deliver(Subscriber *subscriber, const QString &servicePath,
+                 const QVariantMap &counters, bool roaming, const QElapsedTimer &arrived);
+    void handOver(Subscriber *subscriber, const QString &servicePath, bool roaming);
+    void release();
+
+    NetworkManager *m_manager;
+    QString m_path;
+    QList<Subscriber *> m_subscribers;
+    QHash<QString, Totals *> m_totals[2];
+    bool m_registrationPending;
+    bool m_registered;
+    quint32 m_accuracy;
+    quint32 m_interval;
+};
+
+class CounterAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.connman.Counter")
+
+public:
+    explicit CounterAdaptor(CounterHub *parent);
+    virtual ~CounterAdaptor();
+
+public Q_SLOTS:
+    void Release();
+    void Usage(const QDBusObjectPath &service_path,
+                                const QVariantMap &home,
+                                const QVariantMap &roaming);
+
+private:
+    CounterHub *m_hub;
+};
+
+#endif // COUNTERHUB_H
@@ -0,0 +1,31 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef COUNTERUSAGE_P_H
+#define COUNTERUSAGE_P_H
+
+#include <QString>
+
+/*
+ * Shared by CounterAggregator and UsageStore: the intervals usage is kept
+ * at and the keys of the values a Counter reports.
+ */
+namespace CounterUsage {
+
+const qint64 MinuteLength = 60 * 1000; // [ms]
+const qint64 HourLength = 60 * MinuteLength;
+const qint64 DayLength = 24 * HourLength;
+
+const QString RxBytesKey(QLatin1String("RX.Bytes"));
+const QString TxBytesKey(QLatin1String("TX.Bytes"));
+const QString TimeKey(QLatin1String("Time"));
+
+}
+
+#endif // COUNTERUSAGE_P_H
@@ -34,7 +34,13 @@ HEADERS += \
     useragent.h \
     sessionagent.h \
     networksession.h \
-    counter.h
+    counter.h \
+    counterhub.h \
+    routemonitor.h \
+    servicesworker.h \
+    counteraggregator.h \
+    usagestore.h \
+    stringpool.h
 
 SOURCES += \
     networkmanager.cpp \
@@ -46,12 +52,23 @@ SOURCES += \
     useragent.cpp \
     sessionagent.cpp \
     networksession.cpp \
-    counter.cpp
+    counter.cpp \
+    counterhub.cpp \
+    routemonitor.cpp \
+    servicesworker.cpp \
+    counteraggregator.cpp \
+    usagestore.cpp \
+    stringpool.cpp
 
 target.path = $$INSTALL_ROOT$$PREFIX/lib
 
 headers.files = $$HEADERS
 
+# Internal, not installed
+HEADERS += \
+    counterusage_p.h \
+    listreconciler_p.h
+
 QMAKE_PKGCONFIG_DESCRIPTION = Qt Connman Library
 QMAKE_PKGCONFIG_DESTDIR = pkgconfig
 QMAKE_PKGCONFIG_INCDIR = $$headers.path
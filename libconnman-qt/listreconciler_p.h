@@ -0,0 +1,157 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef LISTRECONCILER_P_H
+#define LISTRECONCILER_P_H
+
+#include <QHash>
+#include <QVector>
+
+/*
+ * Brings a list in line with a new order using the fewest steps. Items
+ * which are gone are removed first, contiguous ones as a single range. The
+ * items forming the longest run already in the new order stay in place,
+ * every other one is moved once, and consecutive new items are inserted as
+ * a single range. Replaying the steps on a copy of the old list yields the
+ * new one; subclasses hear of each right before and after it is made.
+ */
+template <typename T>
+class ListReconciler
+{
+public:
+    explicit ListReconciler(QVector<T> &items) : m_items(items) {}
+    virtual ~ListReconciler() {}
+
+    // Returns false if the order did not change at all
+    bool update(const QVector<T> &order);
+
+protected:
+    virtual void aboutToRemove(int first, int last) { Q_UNUSED(first); Q_UNUSED(last); }
+    virtual void removed(int first, int last) { Q_UNUSED(first); Q_UNUSED(last); }
+    virtual void aboutToInsert(int first, int last) { Q_UNUSED(first); Q_UNUSED(last); }
+    virtual void inserted(int first, int last) { Q_UNUSED(first); Q_UNUSED(last); }
+    // The item goes in front of the one at to, as in QAbstractItemModel::beginMoveRows()
+    virtual void aboutToMove(int from, int to) { Q_UNUSED(from); Q_UNUSED(to); }
+    // The item is now at to
+    virtual void moved(int from, int to) { Q_UNUSED(from); Q_UNUSED(to); }
+
+    QVector<T> &m_items;
+};
+
+template <typename T>
+bool ListReconciler<T>::update(const QVector<T> &order)
+{
+    bool changed = false;
+    const int count = order.count();
+
+    QHash<T, int> target;
+    target.reserve(count);
+    for (int i = 0; i < count; ++i)
+        target.insert(order.at(i), i);
+
+    // Back to front so the reported indexes stay valid
+    int last = m_items.count() - 1;
+    while (last >= 0) {
+        if (target.contains(m_items.at(last))) {
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && !target.contains(m_items.at(first - 1)))
+            --first;
+
+        aboutToRemove(first, last);
+        m_items.remove(first, last - first + 1);
+        removed(first, last);
+        changed = true;
+        last = first - 1;
+    }
+
+    // Longest increasing subsequence of the target positions of those left
+    const int rows = m_items.count();
+    QVector<int> positions(rows);
+    QVector<int> previous(rows, -1);
+    QVector<int> tails;
+    tails.reserve(rows);
+
+    for (int i = 0; i < rows; ++i) {
+        positions[i] = target.value(m_items.at(i));
+
+        int low = 0;
+        int high = tails.count();
+        while (low < high) {
+            const int middle = (low + high) / 2;
+            if (positions.at(tails.at(middle)) < positions.at(i))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        if (low > 0)
+            previous[i] = tails.at(low - 1);
+        if (low == tails.count())
+            tails.append(i);
+        else
+            tails[low] = i;
+    }
+
+    QVector<bool> present(count, false);
+    QVector<bool> stable(count, false);
+    for (int i = 0; i < rows; ++i)
+        present[positions.at(i)] = true;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i))
+        stable[positions.at(i)] = true;
+
+    // Back to front, putting each item right before its successor
+    int anchor = m_items.count();
+    int i = count - 1;
+    while (i >= 0) {
+        const T item = order.at(i);
+
+        if (!present.at(i)) {
+            int first = i;
+            while (first > 0 && !present.at(first - 1))
+                --first;
+
+            aboutToInsert(anchor, anchor + i - first);
+            m_items.insert(anchor, i - first + 1, T());
+            for (int j = first; j <= i; ++j)
+                m_items[anchor + j - first] = order.at(j);
+            inserted(anchor, anchor + i - first);
+            changed = true;
+            i = first - 1;
+            continue;
+        }
+
+        if (stable.at(i)) {
+            // Only items still to be moved can be in between
+            anchor = m_items.lastIndexOf(item, anchor - 1);
+        } else {
+            const int from = m_items.indexOf(item);
+            if (from == anchor - 1) {
+                anchor = from;
+            } else {
+                // The index to insert at once it is taken out
+                const int to = from < anchor ? anchor - 1 : anchor;
+                aboutToMove(from, anchor);
+                m_items.remove(from);
+                m_items.insert(to, item);
+                moved(from, to);
+                changed = true;
+                anchor = to;
+            }
+        }
+        --i;
+    }
+
+    return changed;
+}
+
+#endif // LISTRECONCILER_P_H
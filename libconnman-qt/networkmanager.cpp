@@ -11,10 +11,13 @@
 #include "networkmanager.h"
 
 #include "commondbustypes.h"
+#include "listreconciler_p.h"
+#include "routemonitor.h"
+#include "servicesworker.h"
 #include "connman_manager_interface.h"
 #include "connman_manager_interface.cpp" // not bug
 #include "moc_connman_manager_interface.cpp" // not bug
-#include <QRegExp>
+#include <QTimer>
 
 static NetworkManager* staticInstance = NULL;
 
@@ -26,6 +29,12 @@ NetworkManager* NetworkManagerFactory::createInstance()
     return staticInstance;
 }
 
+// Unlike createInstance() this never creates the manager
+NetworkManager* NetworkManagerFactory::existingInstance()
+{
+    return staticInstance;
+}
+
 NetworkManager* NetworkManagerFactory::instance()
 {
     return createInstance();
@@ -41,13 +50,30 @@ NetworkManager::NetworkManager(QObject* parent)
   : QObject(parent),
     m_manager(NULL),
     m_defaultRoute(NULL),
-    m_invalidDefaultRoute(new NetworkService("/", QVariantMap(), this)),
+    m_invalidDefaultRoute(new NetworkService("/", QVariantMap(), this, true)),
+    m_routeMonitor(new RouteMonitor(this)),
     watcher(NULL),
     m_available(false),
     m_servicesEnabled(true),
-    m_technologiesEnabled(true)
+    m_technologiesEnabled(true),
+    m_coalesceChanges(false),
+    m_coalesceInterval(0),
+    m_coalesceTimer(NULL),
+    m_pendingChanges(0),
+    m_propertyFetchesSaved(0),
+    m_dbusThreadEnabled(false),
+    m_serviceSourceConnected(false),
+    m_servicesThread(NULL),
+    m_servicesWorker(NULL),
+    m_servicesByTypeValid(true),
+    m_savedServicesByTypeValid(true),
+    m_recycleTimer(NULL)
 {
     registerCommonDataTypes();
+    m_recycleClock.start();
+    connect(m_routeMonitor, SIGNAL(defaultInterfaceChanged(QString)),
+            this, SLOT(selectDefaultRoute()));
+
     watcher = new QDBusServiceWatcher("net.connman",QDBusConnection::systemBus(),
             QDBusServiceWatcher::WatchForRegistration |
             QDBusServiceWatcher::WatchForUnregistration, this);
@@ -67,6 +93,8 @@ NetworkManager::NetworkManager(QObject* parent)
 
 NetworkManager::~NetworkManager()
 {
+    // The worker thread must not outlive us
+    disconnectServiceSource();
 }
 
 void NetworkManager::connectToConnman(QString)
@@ -126,17 +154,20 @@ void NetworkManager::disconnectTechnologies()
 
 void NetworkManager::disconnectServices()
 {
+    disconnectServiceSource();
+
     if (m_manager) {
-        disconnect(m_manager, SIGNAL(ServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)),
-                   this, SLOT(updateServices(ConnmanObjectList,QList<QDBusObjectPath>)));
         disconnect(m_manager, SIGNAL(SavedServicesChanged(ConnmanObjectList)),
                    this, SLOT(updateSavedServices(ConnmanObjectList)));
     }
 
     Q_FOREACH (NetworkService *service, m_servicesCache)
         service->deleteLater();
+    clearRecycledServices();
 
     m_servicesCache.clear();
+    m_connectedInterfaces.clear();
+    m_serviceInterfaces.clear();
 
     if (m_defaultRoute != m_invalidDefaultRoute) {
         m_defaultRoute = m_invalidDefaultRoute;
@@ -144,12 +175,16 @@ void NetworkManager::disconnectServices()
     }
 
     if (!m_servicesOrder.isEmpty()) {
+        const int last = m_servicesOrder.count() - 1;
         m_servicesOrder.clear();
+        m_servicesByType.clear();
+        Q_EMIT servicesRemoved(0, last);
         Q_EMIT servicesChanged();
     }
 
     if (!m_savedServicesOrder.isEmpty()) {
         m_savedServicesOrder.clear();
+        m_savedServicesByType.clear();
         Q_EMIT savedServicesChanged();
     }
 }
@@ -182,33 +217,106 @@ void NetworkManager::setupServices()
     if (!m_available)
         return;
 
-    connect(m_manager, SIGNAL(ServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)),
-            this, SLOT(updateServices(ConnmanObjectList,QList<QDBusObjectPath>)));
+    connectServiceSource();
+
     connect(m_manager, SIGNAL(SavedServicesChanged(ConnmanObjectList)),
             this, SLOT(updateSavedServices(ConnmanObjectList)));
 
+    QDBusPendingReply<ConnmanObjectList> reply = m_manager->GetSavedServices();
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(getSavedServicesFinished(QDBusPendingCallWatcher*)));
+}
+
+void NetworkManager::updateServices(const ConnmanObjectList &changed, const QList<QDBusObjectPath> &removed)
+{
+    QStringList removedPaths;
+    removedPaths.reserve(removed.count());
+    Q_FOREACH (const QDBusObjectPath &path, removed)
+        removedPaths.append(path.path());
+
+    updateServiceList(changed, removedPaths);
+}
+
+/*
+ * The services list and the property changes of the services come either
+ * straight from the bus or, with dbusThreadEnabled, from a ServicesWorker
+ * which receives and decodes them on its own thread. Either way they come
+ * in the order connman sent them.
+ */
+void NetworkManager::connectServiceSource()
+{
+    if (m_serviceSourceConnected)
+        return;
+    m_serviceSourceConnected = true;
+
+    if (m_dbusThreadEnabled) {
+        m_servicesThread = new QThread(this);
+        m_servicesWorker = new ServicesWorker;
+        m_servicesWorker->moveToThread(m_servicesThread);
+
+        connect(m_servicesWorker, SIGNAL(servicesChanged(ConnmanObjectList,QStringList)),
+                this, SLOT(updateServiceList(ConnmanObjectList,QStringList)));
+        connect(m_servicesWorker, SIGNAL(servicesReceived(ConnmanObjectList)),
+                this, SLOT(setServiceList(ConnmanObjectList)));
+        connect(m_servicesWorker, SIGNAL(servicePropertyChanged(QString,QString,QVariant)),
+                this, SLOT(updateServiceProperty(QString,QString,QVariant)));
+
+        m_servicesThread->start();
+        QMetaObject::invokeMethod(m_servicesWorker, "start", Qt::QueuedConnection);
+        return;
+    }
+
+    connect(m_manager, SIGNAL(ServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)),
+            this, SLOT(updateServices(ConnmanObjectList,QList<QDBusObjectPath>)));
+
+    // One match rule for the property changes of all services
+    QDBusConnection::systemBus().connect("net.connman", QString(), "net.connman.Service",
+            "PropertyChanged", this, SLOT(servicePropertyChanged(QString,QDBusVariant,QDBusMessage)));
+
     QDBusPendingReply<ConnmanObjectList> reply = m_manager->GetServices();
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
     connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
             this, SLOT(getServicesFinished(QDBusPendingCallWatcher*)));
+}
 
-    reply = m_manager->GetSavedServices();
-    watcher = new QDBusPendingCallWatcher(reply, this);
-    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
-            this, SLOT(getSavedServicesFinished(QDBusPendingCallWatcher*)));
+void NetworkManager::disconnectServiceSource()
+{
+    if (!m_serviceSourceConnected)
+        return;
+    m_serviceSourceConnected = false;
+
+    if (m_servicesWorker) {
+        disconnect(m_servicesWorker, 0, this, 0);
+        m_servicesThread->quit();
+        m_servicesThread->wait();
+
+        delete m_servicesWorker;
+        m_servicesWorker = NULL;
+        delete m_servicesThread;
+        m_servicesThread = NULL;
+    }
+
+    QDBusConnection::systemBus().disconnect("net.connman", QString(), "net.connman.Service",
+            "PropertyChanged", this, SLOT(servicePropertyChanged(QString,QDBusVariant,QDBusMessage)));
+
+    if (m_manager) {
+        disconnect(m_manager, SIGNAL(ServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)),
+                   this, SLOT(updateServices(ConnmanObjectList,QList<QDBusObjectPath>)));
+    }
 }
 
-void NetworkManager::updateServices(const ConnmanObjectList &changed, const QList<QDBusObjectPath> &removed)
+void NetworkManager::updateServiceList(const ConnmanObjectList &changed, const QStringList &removed)
 {
     ConnmanObject connmanobj;
     int order = -1;
     NetworkService *service = NULL;
 
-    // make sure we don't leak memory
-    m_servicesOrder.clear();
+    QVector<NetworkService *> servicesOrder;
+    servicesOrder.reserve(changed.count());
 
     QStringList hiddenKnownBssids;
-    QStringList serviceList;
+    QStringList addedServices;
     Q_FOREACH (connmanobj, changed) {
         order++;
         bool addedService = false;
@@ -216,10 +324,7 @@ void NetworkManager::updateServices(const ConnmanObjectList &changed, const QLis
         const QString svcPath(connmanobj.objpath.path());
 
         if (!m_servicesCache.contains(svcPath)) {
-            service = new NetworkService(svcPath,
-                                         connmanobj.properties, this);
-            connect(service,SIGNAL(connectedChanged(bool)),this,SLOT(updateDefaultRoute()));
-            m_servicesCache.insert(svcPath, service);
+            service = addService(svcPath, connmanobj.properties);
             addedService = true;
         } else {
             service = m_servicesCache.value(svcPath);
@@ -240,28 +345,37 @@ void NetworkManager::updateServices(const ConnmanObjectList &changed, const QLis
             continue;
         }
 
-        m_servicesOrder.push_back(service);
-        serviceList.push_back(service->path());
+        servicesOrder.push_back(service);
 
         // If this is no longer a favorite network, remove it from the saved list
         if (!service->favorite()) {
             int savedIndex;
             if ((savedIndex = m_savedServicesOrder.indexOf(service)) != -1) {
                 m_savedServicesOrder.remove(savedIndex);
+                m_savedServicesByTypeValid = false;
             }
         }
         if (order == 0)
             updateDefaultRoute();
 
-        if (addedService) { //Q_EMIT this after m_servicesOrder is updated
-            Q_EMIT serviceAdded(svcPath);
+        if (addedService) {
+            addedServices.append(svcPath);
+            serviceListChanged(service->type(), NetworkTechnology::ServiceAdded);
+        } else if (!connmanobj.properties.isEmpty()) {
+            serviceListChanged(service->type(), NetworkTechnology::ServiceUpdated);
         }
     }
 
-    Q_FOREACH (QDBusObjectPath obj, removed) {
-        const QString svcPath(obj.path());
+    const bool orderChanged = updateServicesOrder(servicesOrder);
+
+    // Q_EMIT these after m_servicesOrder is updated
+    Q_FOREACH (const QString &svcPath, addedServices)
+        Q_EMIT serviceAdded(svcPath);
+
+    Q_FOREACH (const QString &svcPath, removed) {
         if (m_servicesCache.contains(svcPath)) {
             if (NetworkService *service = m_servicesCache.value(svcPath)) {
+                serviceListChanged(service->type(), NetworkTechnology::ServiceRemoved);
                 if (m_savedServicesOrder.contains(service)) {
                     // Don't remove this service from the cache, since the saved model needs it
                     // Update the strength value to zero, so we know it isn't visible
@@ -270,8 +384,10 @@ void NetworkManager::updateServices(const ConnmanObjectList &changed, const QLis
                     properties.insert(QLatin1String("State"), QLatin1String("idle"));
                     service->updateProperties(properties);
                 } else {
-                    service->deleteLater();
                     m_servicesCache.remove(svcPath);
+                    if (removeServiceInterface(service))
+                        selectDefaultRoute();
+                    recycleService(service);
                 }
                 Q_EMIT serviceRemoved(svcPath);
             }
@@ -283,10 +399,147 @@ void NetworkManager::updateServices(const ConnmanObjectList &changed, const QLis
 
     if (order == -1)
         updateDefaultRoute();
-    Q_EMIT servicesChanged();
-    Q_EMIT servicesListChanged(serviceList);
 
-    Q_EMIT savedServicesChanged();
+    Q_FOREACH (NetworkTechnology *technology, m_technologiesCache)
+        technology->serviceListUpdated();
+
+    if (orderChanged)
+        notifyServicesChanged();
+
+    notifySavedServicesChanged();
+}
+
+NetworkService *NetworkManager::addService(const QString &path, const QVariantMap &properties)
+{
+    NetworkService *service = reviveService(path);
+    if (service) {
+        service->setCoalesceInterval(m_coalesceInterval);
+        service->setCoalesceChanges(m_coalesceChanges);
+        service->replaceProperties(properties);
+    } else {
+        service = new NetworkService(path, properties, this, true);
+        connect(service,SIGNAL(connectedChanged(bool)),this,SLOT(serviceInterfaceChanged()));
+        connect(service,SIGNAL(ethernetChanged(QVariantMap)),this,SLOT(serviceInterfaceChanged()));
+
+        service->setCoalesceInterval(m_coalesceInterval);
+        service->setCoalesceChanges(m_coalesceChanges);
+    }
+    updateServiceInterface(service);
+
+    m_servicesCache.insert(service->path(), service);
+    return service;
+}
+
+// Feeds the technology's scan scheduling and scan metrics
+void NetworkManager::serviceListChanged(const QString &type, int change)
+{
+    if (NetworkTechnology *technology = m_technologiesCache.value(type))
+        technology->serviceListChanged(static_cast<NetworkTechnology::ServiceChange>(change));
+}
+
+/*
+ * Services going out of range tend to come back with the next scans. Keep
+ * the most recent ones for a while, so that they keep their identity for
+ * whoever still holds them and nothing has to be constructed again.
+ */
+void NetworkManager::recycleService(NetworkService *service)
+{
+    RecycledService recycled;
+    recycled.service = service;
+    recycled.removedAt = m_recycleClock.elapsed();
+    m_recycledServices.append(recycled);
+
+    while (m_recycledServices.count() > MaxRecycledServices)
+        m_recycledServices.takeFirst().service->deleteLater();
+
+    if (!m_recycleTimer) {
+        m_recycleTimer = new QTimer(this);
+        m_recycleTimer->setSingleShot(true);
+        connect(m_recycleTimer, SIGNAL(timeout()), this, SLOT(expireRecycledServices()));
+    }
+    if (!m_recycleTimer->isActive())
+        expireRecycledServices();
+}
+
+NetworkService *NetworkManager::reviveService(const QString &path)
+{
+    for (int i = 0; i < m_recycledServices.count(); ++i) {
+        if (m_recycledServices.at(i).service->path() == path)
+            return m_recycledServices.takeAt(i).service;
+    }
+    return NULL;
+}
+
+void NetworkManager::expireRecycledServices()
+{
+    const qint64 now = m_recycleClock.elapsed();
+
+    while (!m_recycledServices.isEmpty()) {
+        const qint64 age = now - m_recycledServices.first().removedAt;
+        if (age < RecycledServiceLifetime) {
+            m_recycleTimer->start(RecycledServiceLifetime - age);
+            return;
+        }
+        m_recycledServices.takeFirst().service->deleteLater();
+    }
+    m_recycleTimer->stop();
+}
+
+void NetworkManager::clearRecycledServices()
+{
+    Q_FOREACH (const RecycledService &recycled, m_recycledServices)
+        recycled.service->deleteLater();
+    m_recycledServices.clear();
+
+    if (m_recycleTimer)
+        m_recycleTimer->stop();
+}
+
+/*
+ * Keeps m_servicesOrder in line, announcing each step once it is made.
+ */
+class ServicesOrderReconciler : public ListReconciler<NetworkService *>
+{
+public:
+    explicit ServicesOrderReconciler(NetworkManager *manager)
+        : ListReconciler<NetworkService *>(manager->m_servicesOrder),
+          m_manager(manager)
+    {
+    }
+
+protected:
+    void removed(int first, int last)
+    {
+        m_manager->m_servicesByTypeValid = false;
+        Q_EMIT m_manager->servicesRemoved(first, last);
+    }
+
+    void inserted(int first, int last)
+    {
+        m_manager->m_servicesByTypeValid = false;
+        Q_EMIT m_manager->servicesInserted(first, last);
+    }
+
+    void moved(int from, int to)
+    {
+        m_manager->m_servicesByTypeValid = false;
+        Q_EMIT m_manager->servicesMoved(from, to);
+    }
+
+private:
+    NetworkManager *m_manager;
+};
+
+/*
+ * Brings m_servicesOrder in line with the given order, so that replaying the
+ * emitted servicesRemoved/servicesInserted/servicesMoved signals on a copy of
+ * the previous order yields the new one, see ListReconciler. Returns false
+ * if the order did not change at all.
+ */
+bool NetworkManager::updateServicesOrder(const QVector<NetworkService *> &order)
+{
+    ServicesOrderReconciler reconciler(this);
+    return reconciler.update(order);
 }
 
 void NetworkManager::updateSavedServices(const ConnmanObjectList &changed)
@@ -297,6 +550,7 @@ void NetworkManager::updateSavedServices(const ConnmanObjectList &changed)
 
     // make sure we don't leak memory
     m_savedServicesOrder.clear();
+    m_savedServicesByTypeValid = false;
 
     Q_FOREACH (connmanobj, changed) {
         order++;
@@ -305,9 +559,7 @@ void NetworkManager::updateSavedServices(const ConnmanObjectList &changed)
 
         QHash<QString, NetworkService *>::iterator it = m_servicesCache.find(svcPath);
         if (it == m_servicesCache.end()) {
-            service = new NetworkService(svcPath,
-                                         connmanobj.properties, this);
-            m_servicesCache.insert(svcPath, service);
+            service = addService(svcPath, connmanobj.properties);
         } else {
             service = *it;
             service->updateProperties(connmanobj.properties);
@@ -316,7 +568,7 @@ void NetworkManager::updateSavedServices(const ConnmanObjectList &changed)
         m_savedServicesOrder.push_back(service);
     }
 
-    Q_EMIT savedServicesChanged();
+    notifySavedServicesChanged();
 }
 
 void NetworkManager::propertyChanged(const QString &name, const QDBusVariant &value)
@@ -326,57 +578,87 @@ void NetworkManager::propertyChanged(const QString &name, const QDBusVariant &va
 
 void NetworkManager::updateDefaultRoute()
 {
-    QString defaultNetDev;
-    QFile routeFile("/proc/net/route");
-    if (routeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&routeFile);
-        QString line = in.readLine();
-        while (!line.isNull()) {
-            QStringList lineList = line.split('\t');
-            if (lineList.size() >= 11) {
-                if ((lineList.at(1) == "00000000" && lineList.at(3) == "0003") ||
-                   (lineList.at(0).startsWith("ppp") && lineList.at(3) == "0001")) {
-                    defaultNetDev = lineList.at(0);
-                    break;
-                }
-            }
-            line = in.readLine();
-        }
-        routeFile.close();
-    }
-    if (defaultNetDev.isNull()) {
-         QFile ipv6routeFile("/proc/net/ipv6_route");
-         if (ipv6routeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-             QTextStream ipv6in(&ipv6routeFile);
-             QString ipv6line = ipv6in.readLine();
-             while (!ipv6line.isNull()) {
-                 QStringList ipv6lineList = ipv6line.split(QRegExp("\\s+"));
-                 if (ipv6lineList.size() >= 10) {
-                     if (ipv6lineList.at(0) == "00000000000000000000000000000000" &&
-                        (ipv6lineList.at(8).endsWith("3") || (ipv6lineList.at(8).endsWith("1")))) {
-                         defaultNetDev = ipv6lineList.at(9).trimmed();
-                         break;
-                     }
-                     ipv6line = ipv6in.readLine();
-                 }
-             }
-             ipv6routeFile.close();
-         }
-    }
-
-    Q_FOREACH (NetworkService *service, m_servicesCache) {
-        if (service->state() == "online" || service->state() == "ready") {
-            if (defaultNetDev == service->ethernet().value("Interface")) {
-                if (m_defaultRoute != service) {
-                    m_defaultRoute = service;
-                    Q_EMIT defaultRouteChanged(m_defaultRoute);
-                }
-                return;
-            }
-        }
+    // Without route events the table has to be polled
+    if (!m_routeMonitor->isMonitoring())
+        m_routeMonitor->rescan();
+
+    selectDefaultRoute();
+}
+
+void NetworkManager::selectDefaultRoute()
+{
+    NetworkService *defaultRoute = m_connectedInterfaces.value(m_routeMonitor->defaultInterface(),
+                                                               m_invalidDefaultRoute);
+    if (m_defaultRoute != defaultRoute) {
+        m_defaultRoute = defaultRoute;
+        Q_EMIT defaultRouteChanged(m_defaultRoute);
     }
-    m_defaultRoute = m_invalidDefaultRoute;
-    Q_EMIT defaultRouteChanged(m_defaultRoute);
+}
+
+void NetworkManager::servicePropertyChanged(const QString &name, const QDBusVariant &value,
+                                            const QDBusMessage &message)
+{
+    updateServiceProperty(message.path(), name, value.variant());
+}
+
+void NetworkManager::updateServiceProperty(const QString &servicePath, const QString &name,
+                                           const QVariant &value)
+{
+    NetworkService *service = m_servicesCache.value(servicePath);
+    if (service && service->m_managed)
+        service->emitPropertyChange(name, value);
+}
+
+void NetworkManager::serviceInterfaceChanged()
+{
+    NetworkService *service = qobject_cast<NetworkService *>(sender());
+    if (!service)
+        return;
+
+    const bool changed = updateServiceInterface(service);
+
+    // Without route events the route may have moved along with the service
+    if (!m_routeMonitor->isMonitoring())
+        updateDefaultRoute();
+    else if (changed)
+        selectDefaultRoute();
+}
+
+// Keeps the interface index in sync with the service, returns true if it changed
+bool NetworkManager::updateServiceInterface(NetworkService *service)
+{
+    QString interfaceName;
+    if (service->connected())
+        interfaceName = service->ethernet().value(QLatin1String("Interface")).toString();
+
+    if (interfaceName.isEmpty())
+        return removeServiceInterface(service);
+
+    QHash<NetworkService *, QString>::iterator it = m_serviceInterfaces.find(service);
+    if (it != m_serviceInterfaces.end()) {
+        if (*it == interfaceName)
+            return false;
+        if (m_connectedInterfaces.value(*it) == service)
+            m_connectedInterfaces.remove(*it);
+        *it = interfaceName;
+    } else {
+        m_serviceInterfaces.insert(service, interfaceName);
+    }
+
+    m_connectedInterfaces.insert(interfaceName, service);
+    return true;
+}
+
+bool NetworkManager::removeServiceInterface(NetworkService *service)
+{
+    QHash<NetworkService *, QString>::iterator it = m_serviceInterfaces.find(service);
+    if (it == m_serviceInterfaces.end())
+        return false;
+
+    if (m_connectedInterfaces.value(*it) == service)
+        m_connectedInterfaces.remove(*it);
+    m_serviceInterfaces.erase(it);
+    return true;
 }
 
 void NetworkManager::technologyAdded(const QDBusObjectPath &technology,
@@ -384,6 +666,8 @@ void NetworkManager::technologyAdded(const QDBusObjectPath &technology,
 {
     NetworkTechnology *tech = new NetworkTechnology(technology.path(),
                                                     properties, this);
+    if (!properties.isEmpty())
+        propertyFetchSaved();
 
     m_technologiesCache.insert(tech->type(), tech);
     Q_EMIT technologiesChanged();
@@ -434,6 +718,8 @@ void NetworkManager::getTechnologiesFinished(QDBusPendingCallWatcher *watcher)
     Q_FOREACH (const ConnmanObject &object, reply.value()) {
         NetworkTechnology *tech = new NetworkTechnology(object.objpath.path(),
                                                         object.properties, this);
+        if (!object.properties.isEmpty())
+            propertyFetchSaved();
         m_technologiesCache.insert(tech->type(), tech);
     }
 
@@ -446,9 +732,16 @@ void NetworkManager::getServicesFinished(QDBusPendingCallWatcher *watcher)
     watcher->deleteLater();
     if (reply.isError())
         return;
-    m_servicesOrder.clear();
 
-    Q_FOREACH (const ConnmanObject &object, reply.value()) {
+    setServiceList(reply.value());
+}
+
+void NetworkManager::setServiceList(const ConnmanObjectList &services)
+{
+    QVector<NetworkService *> servicesOrder;
+    servicesOrder.reserve(services.count());
+
+    Q_FOREACH (const ConnmanObject &object, services) {
         const QString servicePath = object.objpath.path();
 
         NetworkService *service;
@@ -458,14 +751,14 @@ void NetworkManager::getServicesFinished(QDBusPendingCallWatcher *watcher)
             service = *it;
             service->updateProperties(object.properties);
         } else {
-            service = new NetworkService(servicePath, object.properties, this);
-            connect(service,SIGNAL(connectedChanged(bool)),this,SLOT(updateDefaultRoute()));
-            m_servicesCache.insert(servicePath, service);
+            service = addService(servicePath, object.properties);
         }
 
-        m_servicesOrder.append(service);
+        servicesOrder.append(service);
     }
 
+    updateServicesOrder(servicesOrder);
+
     updateDefaultRoute();
     Q_EMIT servicesChanged();
     Q_EMIT servicesListChanged(m_servicesCache.keys());
@@ -476,6 +769,7 @@ void NetworkManager::getSavedServicesFinished(QDBusPendingCallWatcher *watcher)
     QDBusPendingReply<ConnmanObjectList> reply = *watcher;
     if (!reply.isError()) {
         m_savedServicesOrder.clear();
+        m_savedServicesByTypeValid = false;
 
         Q_FOREACH (const ConnmanObject &object, reply.value()) {
             const QString servicePath = object.objpath.path();
@@ -487,9 +781,7 @@ void NetworkManager::getSavedServicesFinished(QDBusPendingCallWatcher *watcher)
                 service = *it;
                 service->updateProperties(object.properties);
             } else {
-                service = new NetworkService(servicePath, object.properties, this);
-                connect(service,SIGNAL(connectedChanged(bool)),this,SLOT(updateDefaultRoute()));
-                m_servicesCache.insert(servicePath, service);
+                service = addService(servicePath, object.properties);
             }
 
             m_savedServicesOrder.append(service);
@@ -551,31 +843,52 @@ const QVector<NetworkTechnology *> NetworkManager::getTechnologies() const
 
 const QVector<NetworkService*> NetworkManager::getServices(const QString &tech) const
 {
-    QVector<NetworkService *> services;
-
-    // this Q_FOREACH is based on the m_servicesOrder to keep connman's sort
-    // of services.
-    Q_FOREACH (NetworkService *service, m_servicesOrder) {
-        if (tech.isEmpty() || service->type() == tech)
-            services.push_back(service);
-    }
+    if (tech.isEmpty())
+        return m_servicesOrder;
 
-    return services;
+    updateServiceBuckets();
+    return m_servicesByType.value(tech);
 }
 
 const QVector<NetworkService*> NetworkManager::getSavedServices(const QString &tech) const
 {
-    QVector<NetworkService *> services;
+    updateServiceBuckets();
+    return m_savedServicesByType.value(tech);
+}
 
-    // this Q_FOREACH is based on the m_servicesOrder to keep connman's sort
-    // of services.
-    Q_FOREACH (NetworkService *service, m_savedServicesOrder) {
-        // A previously-saved network which is then removed, remains saved with favorite == false
-        if ((tech.isEmpty() || service->type() == tech) && service->favorite())
-            services.push_back(service);
+/*
+ * The per-technology buckets keep connman's sort of services and are
+ * rebuilt in one pass after the orders change. The vectors handed out
+ * share data with the buckets and stay valid as snapshots.
+ */
+void NetworkManager::updateServiceBuckets() const
+{
+    if (!m_servicesByTypeValid) {
+        m_servicesByType.clear();
+        Q_FOREACH (NetworkService *service, m_servicesOrder)
+            m_servicesByType[service->type()].append(service);
+        m_servicesByTypeValid = true;
     }
 
-    return services;
+    if (!m_savedServicesByTypeValid) {
+        m_savedServicesByType.clear();
+        // The null key holds all of them
+        QVector<NetworkService *> &all = m_savedServicesByType[QString()];
+        Q_FOREACH (NetworkService *service, m_savedServicesOrder) {
+            // A previously-saved network which is then removed, remains saved with favorite == false
+            if (service->favorite()) {
+                all.append(service);
+                m_savedServicesByType[service->type()].append(service);
+            }
+        }
+        m_savedServicesByTypeValid = true;
+    }
+}
+
+void NetworkManager::invalidateServiceBuckets()
+{
+    m_servicesByTypeValid = false;
+    m_savedServicesByTypeValid = false;
 }
 
 // Setters
@@ -614,17 +927,28 @@ void NetworkManager::unregisterCounter(const QString &path)
         m_manager->UnregisterCounter(QDBusObjectPath(path));
 }
 
+// Blocks until connman replies, prefer createSessionAsync()
 QDBusObjectPath NetworkManager::createSession(const QVariantMap &settings, const QString &sessionNotifierPath)
 {
     if (!m_manager)
         return QDBusObjectPath();
 
-    QDBusPendingReply<QDBusObjectPath> reply =
-        m_manager->CreateSession(settings,QDBusObjectPath(sessionNotifierPath));
+    QDBusPendingReply<QDBusObjectPath> reply = createSessionAsync(settings, sessionNotifierPath);
     reply.waitForFinished();
     return reply.value();
 }
 
+QDBusPendingReply<QDBusObjectPath> NetworkManager::createSessionAsync(const QVariantMap &settings,
+                                                                      const QString &sessionNotifierPath)
+{
+    if (!m_manager) {
+        return QDBusPendingReply<QDBusObjectPath>(QDBusPendingCall::fromError(
+                QDBusError(QDBusError::ServiceUnknown, QLatin1String("connman is not available"))));
+    }
+
+    return m_manager->CreateSession(settings, QDBusObjectPath(sessionNotifierPath));
+}
+
 void NetworkManager::destroySession(const QString &sessionAgentPath)
 {
     if (m_manager)
@@ -707,22 +1031,16 @@ void NetworkManager::resetCountersForType(const QString &type)
 QStringList NetworkManager::servicesList(const QString &tech)
 {
     QStringList services;
-    Q_FOREACH (NetworkService *service, m_servicesOrder) {
-        if (tech.isEmpty() || service->type() == tech)
-            services.push_back(service->path());
-    }
+    Q_FOREACH (NetworkService *service, getServices(tech))
+        services.push_back(service->path());
     return services;
 }
 
 QStringList NetworkManager::savedServicesList(const QString &tech)
 {
     QStringList services;
-
-    Q_FOREACH (NetworkService *service, m_savedServicesOrder) {
-        if ((tech.isEmpty() || service->type() == tech) && service->favorite())
-            services.push_back(service->path());
-    }
-
+    Q_FOREACH (NetworkService *service, getSavedServices(tech))
+        services.push_back(service->path());
     return services;
 }
 
@@ -751,3 +1069,152 @@ QStringList NetworkManager::technologiesList()
     }
     return techList;
 }
+
+void NetworkManager::notifyServicesChanged()
+{
+    if (m_coalesceChanges) {
+        m_pendingChanges |= ServicesChangePending;
+        scheduleFlush();
+        return;
+    }
+
+    Q_EMIT servicesChanged();
+    Q_EMIT servicesListChanged(servicesList(QString()));
+}
+
+void NetworkManager::notifySavedServicesChanged()
+{
+    if (m_coalesceChanges) {
+        m_pendingChanges |= SavedServicesChangePending;
+        scheduleFlush();
+        return;
+    }
+
+    Q_EMIT savedServicesChanged();
+}
+
+void NetworkManager::scheduleFlush()
+{
+    if (!m_coalesceTimer) {
+        m_coalesceTimer = new QTimer(this);
+        m_coalesceTimer->setSingleShot(true);
+        m_coalesceTimer->setInterval(m_coalesceInterval);
+        connect(m_coalesceTimer, SIGNAL(timeout()), this, SLOT(flushChanges()));
+    }
+
+    if (!m_coalesceTimer->isActive())
+        m_coalesceTimer->start();
+}
+
+void NetworkManager::flushChanges()
+{
+    if (m_coalesceTimer)
+        m_coalesceTimer->stop();
+
+    const int pending = m_pendingChanges;
+    m_pendingChanges = 0;
+
+    if (pending & ServicesChangePending) {
+        Q_EMIT servicesChanged();
+        Q_EMIT servicesListChanged(servicesList(QString()));
+    }
+    if (pending & SavedServicesChangePending)
+        Q_EMIT savedServicesChanged();
+}
+
+NetworkService *NetworkManager::cachedService(const QString &path) const
+{
+    return m_servicesCache.value(path);
+}
+
+NetworkTechnology *NetworkManager::cachedTechnology(const QString &path) const
+{
+    Q_FOREACH (NetworkTechnology *tech, m_technologiesCache) {
+        if (tech->path() == path)
+            return tech;
+    }
+    return NULL;
+}
+
+void NetworkManager::propertyFetchSaved()
+{
+    ++m_propertyFetchesSaved;
+}
+
+int NetworkManager::propertyFetchesSaved() const
+{
+    return m_propertyFetchesSaved;
+}
+
+bool NetworkManager::dbusThreadEnabled() const
+{
+    return m_dbusThreadEnabled;
+}
+
+/*
+ * Takes effect right away, the list of services is then fetched again
+ * through the new path.
+ */
+void NetworkManager::setDBusThreadEnabled(bool enabled)
+{
+    if (m_dbusThreadEnabled == enabled)
+        return;
+
+    const bool connected = m_serviceSourceConnected;
+    disconnectServiceSource();
+
+    m_dbusThreadEnabled = enabled;
+
+    if (connected)
+        connectServiceSource();
+
+    Q_EMIT dbusThreadEnabledChanged(m_dbusThreadEnabled);
+}
+
+bool NetworkManager::coalesceChanges() const
+{
+    return m_coalesceChanges;
+}
+
+/*
+ * Coalesces servicesChanged(), servicesListChanged() and
+ * savedServicesChanged() into one emission per coalesceInterval and puts
+ * all services, current and future, into the same mode. The fine-grained
+ * servicesInserted/Removed/Moved signals are never delayed since their
+ * indexes are only valid at the time of the change.
+ */
+void NetworkManager::setCoalesceChanges(bool coalesce)
+{
+    if (m_coalesceChanges == coalesce)
+        return;
+
+    m_coalesceChanges = coalesce;
+
+    Q_FOREACH (NetworkService *service, m_servicesCache)
+        service->setCoalesceChanges(m_coalesceChanges);
+
+    if (!m_coalesceChanges)
+        flushChanges();
+
+    Q_EMIT coalesceChangesChanged(m_coalesceChanges);
+}
+
+int NetworkManager::coalesceInterval() const
+{
+    return m_coalesceInterval;
+}
+
+void NetworkManager::setCoalesceInterval(int interval)
+{
+    if (interval < 0 || m_coalesceInterval == interval)
+        return;
+
+    m_coalesceInterval = interval;
+    if (m_coalesceTimer)
+        m_coalesceTimer->setInterval(m_coalesceInterval);
+
+    Q_FOREACH (NetworkService *service, m_servicesCache)
+        service->setCoalesceInterval(m_coalesceInterval);
+
+    Q_EMIT coalesceIntervalChanged(m_coalesceInterval);
+}
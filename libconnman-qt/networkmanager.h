@@ -16,8 +16,11 @@
 #include "networktechnology.h"
 #include "networkservice.h"
 #include <QtDBus>
+#include <QElapsedTimer>
 
 class NetConnmanManagerInterface;
+class RouteMonitor;
+class ServicesWorker;
 class NetworkManager;
 
 class NetworkManagerFactory : public QObject
@@ -28,6 +31,7 @@ class NetworkManagerFactory : public QObject
 
 public:
     static NetworkManager* createInstance();
+    static NetworkManager* existingInstance();
     NetworkManager* instance();
 };
 
@@ -45,6 +49,11 @@ class NetworkManager : public QObject
     Q_PROPERTY(bool servicesEnabled READ servicesEnabled WRITE setServicesEnabled NOTIFY servicesEnabledChanged)
     Q_PROPERTY(bool technologiesEnabled READ technologiesEnabled WRITE setTechnologiesEnabled NOTIFY technologiesEnabledChanged)
 
+    Q_PROPERTY(bool coalesceChanges READ coalesceChanges WRITE setCoalesceChanges NOTIFY coalesceChangesChanged)
+    Q_PROPERTY(int coalesceInterval READ coalesceInterval WRITE setCoalesceInterval NOTIFY coalesceIntervalChanged)
+
+    Q_PROPERTY(bool dbusThreadEnabled READ dbusThreadEnabled WRITE setDBusThreadEnabled NOTIFY dbusThreadEnabledChanged)
+
 public:
     NetworkManager(QObject* parent=0);
     virtual ~NetworkManager();
@@ -76,6 +85,18 @@ public:
     bool technologiesEnabled() const;
     void setTechnologiesEnabled(bool enabled);
 
+    bool coalesceChanges() const;
+    void setCoalesceChanges(bool coalesce);
+    int coalesceInterval() const;
+    void setCoalesceInterval(int interval);
+
+    /* Receive and decode the services list on a separate thread */
+    bool dbusThreadEnabled() const;
+    void setDBusThreadEnabled(bool enabled);
+
+    /* GetProperties calls avoided by seeding objects with known properties */
+    int propertyFetchesSaved() const;
+
     Q_INVOKABLE void resetCountersForType(const QString &type);
 
 public Q_SLOTS:
@@ -85,6 +106,8 @@ public Q_SLOTS:
     void registerCounter(const QString &path, quint32 accuracy,quint32 period);
     void unregisterCounter(const QString &path);
     QDBusObjectPath createSession(const QVariantMap &settings, const QString &sessionNotifierPath);
+    QDBusPendingReply<QDBusObjectPath> createSessionAsync(const QVariantMap &settings,
+                                                          const QString &sessionNotifierPath);
     void destroySession(const QString &sessionAgentPath);
 
     void setSessionMode(const bool &sessionMode);
@@ -103,11 +126,53 @@ Q_SIGNALS:
     void serviceAdded(const QString &servicePath);
     void serviceRemoved(const QString &servicePath);
 
+    /* Fine-grained changes of the services order, indexes as in getServices() */
+    void servicesInserted(int first, int last);
+    void servicesRemoved(int first, int last);
+    void servicesMoved(int from, int to);
+
     void servicesEnabledChanged();
     void technologiesEnabledChanged();
+    void coalesceChangesChanged(bool coalesce);
+    void coalesceIntervalChanged(int interval);
+    void dbusThreadEnabledChanged(bool enabled);
 
 private:
     void propertyChanged(const QString &name, const QVariant &value);
+    NetworkService *addService(const QString &path, const QVariantMap &properties);
+    NetworkService *cachedService(const QString &path) const;
+    NetworkTechnology *cachedTechnology(const QString &path) const;
+    void propertyFetchSaved();
+    bool updateServiceInterface(NetworkService *service);
+    bool removeServiceInterface(NetworkService *service);
+    void updateServiceBuckets() const;
+    void invalidateServiceBuckets();
+    void connectServiceSource();
+    void disconnectServiceSource();
+    bool updateServicesOrder(const QVector<NetworkService *> &order);
+    void notifyServicesChanged();
+    void notifySavedServicesChanged();
+    void scheduleFlush();
+
+    void serviceListChanged(const QString &type, int change);
+    void recycleService(NetworkService *service);
+    NetworkService *reviveService(const QString &path);
+    void clearRecycledServices();
+
+    enum PendingChange {
+        ServicesChangePending = 0x1,
+        SavedServicesChangePending = 0x2
+    };
+
+    enum {
+        MaxRecycledServices = 32,
+        RecycledServiceLifetime = 120000 // [ms]
+    };
+
+    struct RecycledService {
+        NetworkService *service;
+        qint64 removedAt;
+    };
 
     NetConnmanManagerInterface *m_manager;
 
@@ -128,6 +193,13 @@ private:
     /* Invalid default route service for use when there is no default route */
     NetworkService *m_invalidDefaultRoute;
 
+    /* Tracks the interface holding the default route */
+    RouteMonitor *m_routeMonitor;
+
+    /* Connected services by kernel interface name, and the reverse */
+    QHash<QString, NetworkService *> m_connectedInterfaces;
+    QHash<NetworkService *, QString> m_serviceInterfaces;
+
     QDBusServiceWatcher *watcher;
 
     static const QString State;
@@ -139,6 +211,28 @@ private:
     bool m_servicesEnabled;
     bool m_technologiesEnabled;
 
+    bool m_coalesceChanges;
+    int m_coalesceInterval;
+    QTimer *m_coalesceTimer;
+    int m_pendingChanges;
+
+    int m_propertyFetchesSaved;
+
+    bool m_dbusThreadEnabled;
+    bool m_serviceSourceConnected;
+    QThread *m_servicesThread;
+    ServicesWorker *m_servicesWorker;
+
+    /* Services of m_servicesOrder and m_savedServicesOrder by type, built on demand */
+    mutable QHash<QString, QVector<NetworkService *> > m_servicesByType;
+    mutable QHash<QString, QVector<NetworkService *> > m_savedServicesByType;
+    mutable bool m_servicesByTypeValid;
+    mutable bool m_savedServicesByTypeValid;
+
+    /* Recently removed services, oldest first, revived if their path comes back */
+    QList<RecycledService> m_recycledServices;
+    QElapsedTimer m_recycleClock;
+    QTimer *m_recycleTimer;
 
 private Q_SLOTS:
     void connectToConnman(QString = QString());
@@ -150,16 +244,30 @@ private Q_SLOTS:
     void setupServices();
     void propertyChanged(const QString &name, const QDBusVariant &value);
     void updateServices(const ConnmanObjectList &changed, const QList<QDBusObjectPath> &removed);
+    void updateServiceList(const ConnmanObjectList &changed, const QStringList &removed);
+    void setServiceList(const ConnmanObjectList &services);
     void updateSavedServices(const ConnmanObjectList &changed);
     void technologyAdded(const QDBusObjectPath &technology, const QVariantMap &properties);
     void technologyRemoved(const QDBusObjectPath &technology);
     void getPropertiesFinished(QDBusPendingCallWatcher *watcher);
     void updateDefaultRoute();
+    void selectDefaultRoute();
+    void serviceInterfaceChanged();
+    void servicePropertyChanged(const QString &name, const QDBusVariant &value,
+                                const QDBusMessage &message);
+    void updateServiceProperty(const QString &servicePath, const QString &name,
+                               const QVariant &value);
     void getTechnologiesFinished(QDBusPendingCallWatcher *watcher);
     void getServicesFinished(QDBusPendingCallWatcher *watcher);
     void getSavedServicesFinished(QDBusPendingCallWatcher *watcher);
+    void flushChanges();
+    void expireRecycledServices();
 
 private:
+    friend class NetworkService;
+    friend class NetworkTechnology;
+    friend class ServicesOrderReconciler;
+
     Q_DISABLE_COPY(NetworkManager)
 };
 
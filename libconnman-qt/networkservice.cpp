@@ -9,6 +9,7 @@
  */
 
 #include "networkservice.h"
+#include "networkmanager.h"
 #include "commondbustypes.h"
 #include "connman_manager_interface.h"
 #include "connman_service_interface.h"
@@ -67,16 +68,76 @@ const QString NetworkService::Frequency("Frequency");
 const QString NetworkService::EncryptionMode("EncryptionMode");
 const QString NetworkService::Hidden("Hidden");
 
+namespace {
+
+template <typename T>
+bool assign(quint32 &known, int id, T &slot, const T &value)
+{
+    const quint32 bit = 1u << id;
+    if ((known & bit) && slot == value)
+        return false;
+
+    known |= bit;
+    slot = value;
+    return true;
+}
+
+}
+
+NetworkService::Properties::Properties()
+  : stateId(StringPool::UnknownState),
+    strength(0),
+    maxRate(0),
+    frequency(0),
+    favorite(false),
+    autoConnect(false),
+    roaming(false),
+    hidden(false)
+{
+}
+
 NetworkService::NetworkService(const QString &path, const QVariantMap &properties, QObject* parent)
   : QObject(parent),
     m_service(NULL),
-    m_path(path),
-    m_propertiesCache(properties),
+    m_path(StringPool::intern(path)),
+    m_knownProperties(0),
+    m_coalesceChanges(false),
+    m_coalesceInterval(0),
+    m_coalesceTimer(NULL),
+    m_dirtyProperties(0),
+    m_managed(false),
     isConnected(false)
+{
+    init(properties);
+}
+
+NetworkService::NetworkService(const QString &path, const QVariantMap &properties, QObject* parent,
+                               bool managed)
+  : QObject(parent),
+    m_service(NULL),
+    m_path(StringPool::intern(path)),
+    m_knownProperties(0),
+    m_coalesceChanges(false),
+    m_coalesceInterval(0),
+    m_coalesceTimer(NULL),
+    m_dirtyProperties(0),
+    m_managed(managed),
+    isConnected(false)
+{
+    init(properties);
+}
+
+void NetworkService::init(const QVariantMap &properties)
 {
     qRegisterMetaType<NetworkService *>();
 
-    Q_ASSERT(!path.isEmpty());
+    Q_ASSERT(!m_path.isEmpty());
+
+    // nothing is connected to us yet, so this only fills in the cache
+    QVariantMap::const_iterator it = properties.constBegin(), end = properties.constEnd();
+    for ( ; it != end; ++it)
+        emitPropertyChange(it.key(), it.value());
+
     reconnectServiceInterface();
 }
 
@@ -84,6 +145,12 @@ NetworkService::NetworkService(QObject* parent)
     : QObject(parent),
       m_service(NULL),
       m_path(QString()),
+      m_knownProperties(0),
+      m_coalesceChanges(false),
+      m_coalesceInterval(0),
+      m_coalesceTimer(NULL),
+      m_dirtyProperties(0),
+      m_managed(false),
       isConnected(false)
 {
     qRegisterMetaType<NetworkService *>();
@@ -93,58 +160,47 @@ NetworkService::~NetworkService() {}
 
 const QString NetworkService::name() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Name))
-        return m_propertiesCache.value(Name).toString();
-    return QString();
+    return m_properties.name;
 }
 
 const QString NetworkService::state() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(State))
-        return m_propertiesCache.value(State).toString();
-    return QString();
+    return m_properties.state;
+}
+
+NetworkService::ServiceState NetworkService::serviceState() const
+{
+    return static_cast<ServiceState>(m_properties.stateId);
 }
 
 const QString NetworkService::error() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Error))
-        return m_propertiesCache.value(Error).toString();
-    return QString();
+    return m_properties.error;
 }
 
 const QString NetworkService::type() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Type))
-        return m_propertiesCache.value(Type).toString();
-    return QString();
+    return m_properties.type;
 }
 
 const QStringList NetworkService::security() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Security))
-        return m_propertiesCache.value(Security).toStringList();
-    return QStringList();
+    return m_properties.security;
 }
 
 uint NetworkService::strength() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Strength))
-        return m_propertiesCache.value(Strength).toUInt();
-    return 0;
+    return m_properties.strength;
 }
 
 bool NetworkService::favorite() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Favorite))
-        return m_propertiesCache.value(Favorite).toBool();
-    return false;
+    return m_properties.favorite;
 }
 
 bool NetworkService::autoConnect() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(AutoConnect))
-        return m_propertiesCache.value(AutoConnect).toBool();
-    return false;
+    return m_properties.autoConnect;
 }
 
 const QString NetworkService::path() const
@@ -154,98 +210,72 @@ const QString NetworkService::path() const
 
 const QVariantMap NetworkService::ipv4() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(IPv4))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv4));
-    return QVariantMap();
+    return m_properties.ipv4;
 }
 
 const QVariantMap NetworkService::ipv4Config() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(IPv4Config))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv4Config));
-    return QVariantMap();
+    return m_properties.ipv4Config;
 }
 
 const QVariantMap NetworkService::ipv6() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(IPv6))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv6));
-    return QVariantMap();
+    return m_properties.ipv6;
 }
 
 const QVariantMap NetworkService::ipv6Config() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(IPv6Config))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv6Config));
-    return QVariantMap();
+    return m_properties.ipv6Config;
 }
 
 const QStringList NetworkService::nameservers() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Nameservers))
-        return m_propertiesCache.value(Nameservers).toStringList();
-    return QStringList();
+    return m_properties.nameservers;
 }
 
 const QStringList NetworkService::nameserversConfig() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(NameserversConfig))
-        return m_propertiesCache.value(NameserversConfig).toStringList();
-    return QStringList();
+    return m_properties.nameserversConfig;
 }
 
 const QStringList NetworkService::domains() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Domains))
-        return m_propertiesCache.value(Domains).toStringList();
-    return QStringList();
+    return m_properties.domains;
 }
 
 const QStringList NetworkService::domainsConfig() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(DomainsConfig))
-        return m_propertiesCache.value(DomainsConfig).toStringList();
-    return QStringList();
+    return m_properties.domainsConfig;
 }
 
 const QVariantMap NetworkService::proxy() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Proxy))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(Proxy));
-    return QVariantMap();
+    return m_properties.proxy;
 }
 
 const QVariantMap NetworkService::proxyConfig() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(ProxyConfig))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(ProxyConfig));
-    return QVariantMap();
+    return m_properties.proxyConfig;
 }
 
 const QVariantMap NetworkService::ethernet() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Ethernet))
-        return qdbus_cast<QVariantMap>(m_propertiesCache.value(Ethernet));
-    return QVariantMap();
+    return m_properties.ethernet;
 }
 
 bool NetworkService::roaming() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Roaming))
-        return m_propertiesCache.value(Roaming).toBool();
-    return false;
+    return m_properties.roaming;
 }
 
 bool NetworkService::hidden() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Hidden))
-        return m_propertiesCache.value(Hidden).toBool();
-    return false;
+    return m_properties.hidden;
 }
 
 void NetworkService::requestConnect()
 {
-    if (!m_service) {
+    if (!serviceInterface()) {
         return;
     }
     if (connected()) {
@@ -256,7 +286,7 @@ void NetworkService::requestConnect()
 
     // If the service is in the failure state clear the Error property so that we get notified of
     // errors on subsequent connection attempts.
-    if (state() == QLatin1String("failure"))
+    if (m_properties.stateId == StringPool::FailureState)
         m_service->ClearProperty(QLatin1String("Error"));
 
     // increase reply timeout when connecting
@@ -278,7 +308,7 @@ void NetworkService::requestConnect()
 
 void NetworkService::requestDisconnect()
 {
-    if (m_service) {
+    if (serviceInterface()) {
         Q_EMIT serviceDisconnectionStarted();
         m_service->Disconnect();
     }
@@ -286,7 +316,7 @@ void NetworkService::requestDisconnect()
 
 void NetworkService::remove()
 {
-    if (!m_service)
+    if (!serviceInterface())
         return;
 
     QDBusPendingReply<> reply = m_service->Remove();
@@ -297,7 +327,7 @@ void NetworkService::remove()
 
 void NetworkService::setAutoConnect(bool autoConnected)
 {
-    if (m_service) {
+    if (serviceInterface()) {
          QDBusPendingReply<void> reply = m_service->SetProperty(AutoConnect, QDBusVariant(QVariant(autoConnected)));
 
          QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
@@ -319,41 +349,41 @@ void NetworkService::handleAutoConnectReply(QDBusPendingCallWatcher *watcher)
 void NetworkService::setIpv4Config(const QVariantMap &ipv4)
 {
     // QDBusPendingReply<void> reply =
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(IPv4Config, QDBusVariant(QVariant(ipv4)));
 }
 
 void NetworkService::setIpv6Config(const QVariantMap &ipv6)
 {
     // QDBusPendingReply<void> reply =
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(IPv6Config, QDBusVariant(QVariant(ipv6)));
 }
 
 void NetworkService::setNameserversConfig(const QStringList &nameservers)
 {
     // QDBusPendingReply<void> reply =
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(NameserversConfig, QDBusVariant(QVariant(nameservers)));
 }
 
 void NetworkService::setDomainsConfig(const QStringList &domains)
 {
     // QDBusPendingReply<void> reply =
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(DomainsConfig, QDBusVariant(QVariant(domains)));
 }
 
 void NetworkService::setProxyConfig(const QVariantMap &proxy)
 {
     // QDBusPendingReply<void> reply =
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(ProxyConfig, QDBusVariant(QVariant(adaptToConnmanProperties(proxy))));
 }
 
 void NetworkService::resetCounters()
 {
-    if (m_service)
+    if (serviceInterface())
         m_service->ResetCounters();
 }
 
@@ -390,72 +420,22 @@ void NetworkService::handleRemoveReply(QDBusPendingCallWatcher *watcher)
 
 void NetworkService::resetProperties()
 {
-    QMutableMapIterator<QString, QVariant> i(m_propertiesCache);
-    while (i.hasNext()) {
-        i.next();
-
-        const QString key = i.key();
-        i.remove();
-
-        if (key == Name) {
-            Q_EMIT nameChanged(name());
-        } else if (key == Error) {
-            Q_EMIT errorChanged(error());
-        } else if (key == State) {
-            Q_EMIT stateChanged(state());
-            if (isConnected != connected()) {
-                isConnected = connected();
-                Q_EMIT connectedChanged(isConnected);
-            }
-        } else if (key == Security) {
-            Q_EMIT securityChanged(security());
-        } else if (key == Strength) {
-            Q_EMIT strengthChanged(strength());
-        } else if (key == Favorite) {
-            Q_EMIT favoriteChanged(favorite());
-        } else if (key == AutoConnect) {
-            Q_EMIT autoConnectChanged(autoConnect());
-        } else if (key == IPv4) {
-            Q_EMIT ipv4Changed(ipv4());
-        } else if (key == IPv4Config) {
-            Q_EMIT ipv4ConfigChanged(ipv4Config());
-        } else if (key == IPv6) {
-            Q_EMIT ipv6Changed(ipv6());
-        } else if (key == IPv6Config) {
-            Q_EMIT ipv6ConfigChanged(ipv6Config());
-        } else if (key == Nameservers) {
-            Q_EMIT nameserversChanged(nameservers());
-        } else if (key == NameserversConfig) {
-            Q_EMIT nameserversConfigChanged(nameserversConfig());
-        } else if (key == Domains) {
-            Q_EMIT domainsChanged(domains());
-        } else if (key == DomainsConfig) {
-            Q_EMIT domainsConfigChanged(domainsConfig());
-        } else if (key == Proxy) {
-            Q_EMIT proxyChanged(proxy());
-        } else if (key == ProxyConfig) {
-            Q_EMIT proxyConfigChanged(proxyConfig());
-        } else if (key == Ethernet) {
-            Q_EMIT ethernetChanged(ethernet());
-        } else if (key == QLatin1String("Type")) {
-            Q_EMIT typeChanged(type());
-        } else if (key == Roaming) {
-            Q_EMIT roamingChanged(roaming());
-        } else if (key == Timeservers) {
-            Q_EMIT timeserversChanged(timeservers());
-        } else if (key == TimeserversConfig) {
-            Q_EMIT timeserversConfigChanged(timeserversConfig());
-        } else if (key == BSSID) {
-            Q_EMIT bssidChanged(bssid());
-        } else if (key == MaxRate) {
-            Q_EMIT maxRateChanged(maxRate());
-        } else if (key == Frequency) {
-            Q_EMIT frequencyChanged(frequency());
-        } else if (key == EncryptionMode) {
-            Q_EMIT encryptionModeChanged(encryptionMode());
-        } else if (key == Hidden) {
-            Q_EMIT hiddenChanged(hidden());
-        }
+    const quint32 known = m_knownProperties;
+
+    m_properties = Properties();
+    m_knownProperties = 0;
+    m_propertiesCache.clear();
+
+    if (m_coalesceChanges) {
+        m_dirtyProperties |= known;
+        if (known)
+            schedulePropertyFlush();
+        return;
+    }
+
+    for (int id = 0; id < PropertyCount; ++id) {
+        if (known & (1u << id))
+            emitPropertySignal(id);
     }
 }
 
@@ -469,83 +449,289 @@ void NetworkService::reconnectServiceInterface()
     if (m_path.isEmpty())
         return;
 
-    m_service = new NetConnmanServiceInterface("net.connman", m_path,
-                                               QDBusConnection::systemBus(), this);
-
-    connect(m_service, SIGNAL(PropertyChanged(QString,QDBusVariant)),
-            this, SLOT(updateProperty(QString,QDBusVariant)));
+    // NetworkManager passes on property changes to the services it owns
+    if (!m_managed) {
+        connect(serviceInterface(), SIGNAL(PropertyChanged(QString,QDBusVariant)),
+                this, SLOT(updateProperty(QString,QDBusVariant)));
+    }
 
     QTimer::singleShot(500,this,SIGNAL(propertiesReady()));
 }
 
-void NetworkService::emitPropertyChange(const QString &name, const QVariant &value)
+// The method call proxy is only created once it is needed
+NetConnmanServiceInterface *NetworkService::serviceInterface()
+{
+    if (!m_service && !m_path.isEmpty()) {
+        m_service = new NetConnmanServiceInterface("net.connman", m_path,
+                                                   QDBusConnection::systemBus(), this);
+    }
+    return m_service;
+}
+
+// Indexed by PropertyId, also read by the D-Bus demarshalling thread
+const QStringList &NetworkService::propertyNames()
+{
+    static const QStringList names = QStringList()
+            << Name << State << Type << Security << Strength << Error << Favorite
+            << AutoConnect << IPv4 << IPv4Config << IPv6 << IPv6Config
+            << Nameservers << NameserversConfig << Domains << DomainsConfig
+            << Proxy << ProxyConfig << Ethernet << Roaming
+            << Timeservers << TimeserversConfig
+            << BSSID << MaxRate << Frequency << EncryptionMode << Hidden;
+    Q_ASSERT(names.count() == PropertyCount);
+    return names;
+}
+
+int NetworkService::propertyId(const QString &name)
+{
+    static QHash<QString, int> ids;
+    if (ids.isEmpty()) { // init once
+        const QStringList &names = propertyNames();
+        for (int id = 0; id < names.count(); ++id)
+            ids.insert(names.at(id), id);
+    }
+    return ids.value(name, -1);
+}
+
+bool NetworkService::storeProperty(int id, const QVariant &value)
+{
+    Properties &p = m_properties;
+    quint32 &known = m_knownProperties;
+
+    switch (id) {
+    case NameProperty:
+        return assign(known, id, p.name, value.toString());
+    case StateProperty:
+        if (!assign(known, id, p.state, StringPool::intern(value.toString())))
+            return false;
+        p.stateId = StringPool::state(p.state);
+        return true;
+    case TypeProperty:
+        if (!assign(known, id, p.type, StringPool::intern(value.toString())))
+            return false;
+        invalidateManagerBuckets();
+        return true;
+    case SecurityProperty:
+        return assign(known, id, p.security, value.toStringList());
+    case StrengthProperty:
+        return assign(known, id, p.strength, value.toUInt());
+    case ErrorProperty:
+        return assign(known, id, p.error, value.toString());
+    case FavoriteProperty:
+        if (!assign(known, id, p.favorite, value.toBool()))
+            return false;
+        invalidateManagerBuckets();
+        return true;
+    case AutoConnectProperty:
+        return assign(known, id, p.autoConnect, value.toBool());
+    case IPv4Property:
+        return assign(known, id, p.ipv4, qdbus_cast<QVariantMap>(value));
+    case IPv4ConfigProperty:
+        return assign(known, id, p.ipv4Config, qdbus_cast<QVariantMap>(value));
+    case IPv6Property:
+        return assign(known, id, p.ipv6, qdbus_cast<QVariantMap>(value));
+    case IPv6ConfigProperty:
+        return assign(known, id, p.ipv6Config, qdbus_cast<QVariantMap>(value));
+    case NameserversProperty:
+        return assign(known, id, p.nameservers, value.toStringList());
+    case NameserversConfigProperty:
+        return assign(known, id, p.nameserversConfig, value.toStringList());
+    case DomainsProperty:
+        return assign(known, id, p.domains, value.toStringList());
+    case DomainsConfigProperty:
+        return assign(known, id, p.domainsConfig, value.toStringList());
+    case ProxyProperty:
+        return assign(known, id, p.proxy, qdbus_cast<QVariantMap>(value));
+    case ProxyConfigProperty:
+        return assign(known, id, p.proxyConfig, qdbus_cast<QVariantMap>(value));
+    case EthernetProperty:
+        return assign(known, id, p.ethernet, qdbus_cast<QVariantMap>(value));
+    case RoamingProperty:
+        return assign(known, id, p.roaming, value.toBool());
+    case TimeserversProperty:
+        return assign(known, id, p.timeservers, value.toStringList());
+    case TimeserversConfigProperty:
+        return assign(known, id, p.timeserversConfig, value.toStringList());
+    case BSSIDProperty:
+        return assign(known, id, p.bssid, value.toString());
+    case MaxRateProperty:
+        return assign(known, id, p.maxRate, value.toUInt());
+    case FrequencyProperty:
+        return assign(known, id, p.frequency, static_cast<quint16>(value.toUInt()));
+    case EncryptionModeProperty:
+        return assign(known, id, p.encryptionMode, value.toString());
+    case HiddenProperty:
+        return assign(known, id, p.hidden, value.toBool());
+    }
+    return false;
+}
+
+// The manager's buckets go by type and favorite, which may be signalled late
+void NetworkService::invalidateManagerBuckets()
 {
-    if (m_propertiesCache.value(name) == value)
+    if (!m_managed)
         return;
 
-        m_propertiesCache[name] = value;
+    if (NetworkManager *manager = qobject_cast<NetworkManager *>(parent()))
+        manager->invalidateServiceBuckets();
+}
 
-    if (name == Name) {
-        Q_EMIT nameChanged(value.toString());
-    } else if (name == Error) {
-        Q_EMIT errorChanged(value.toString());
-    } else if (name == State) {
-        Q_EMIT stateChanged(value.toString());
+void NetworkService::emitPropertySignal(int id)
+{
+    const Properties &p = m_properties;
+
+    switch (id) {
+    case NameProperty:
+        Q_EMIT nameChanged(p.name);
+        break;
+    case StateProperty:
+        Q_EMIT stateChanged(p.state);
+        Q_EMIT serviceStateChanged(serviceState());
         if (isConnected != connected()) {
             isConnected = connected();
             Q_EMIT connectedChanged(isConnected);
         }
-    } else if (name == Security) {
-        Q_EMIT securityChanged(value.toStringList());
-    } else if (name == Strength) {
-        Q_EMIT strengthChanged(value.toUInt());
-    } else if (name == Favorite) {
-        Q_EMIT favoriteChanged(value.toBool());
-    } else if (name == AutoConnect) {
-        Q_EMIT autoConnectChanged(value.toBool());
-    } else if (name == IPv4) {
-        Q_EMIT ipv4Changed(qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv4)));
-    } else if (name == IPv4Config) {
-        Q_EMIT ipv4ConfigChanged(qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv4Config)));
-    } else if (name == IPv6) {
-        Q_EMIT ipv6Changed(qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv6)));
-    } else if (name == IPv6Config) {
-        Q_EMIT ipv6ConfigChanged(qdbus_cast<QVariantMap>(m_propertiesCache.value(IPv6Config)));
-    } else if (name == Nameservers) {
-        Q_EMIT nameserversChanged(value.toStringList());
-    } else if (name == NameserversConfig) {
-        Q_EMIT nameserversConfigChanged(value.toStringList());
-    } else if (name == Domains) {
-        Q_EMIT domainsChanged(value.toStringList());
-    } else if (name == DomainsConfig) {
-        Q_EMIT domainsConfigChanged(value.toStringList());
-    } else if (name == Proxy) {
-        Q_EMIT proxyChanged(qdbus_cast<QVariantMap>(m_propertiesCache.value(Proxy)));
-    } else if (name == ProxyConfig) {
-        Q_EMIT proxyConfigChanged(qdbus_cast<QVariantMap>(m_propertiesCache.value(ProxyConfig)));
-    } else if (name == Ethernet) {
-        Q_EMIT ethernetChanged(qdbus_cast<QVariantMap>(m_propertiesCache.value(Ethernet)));
-    } else if (name == QLatin1String("Type")) {
-        Q_EMIT typeChanged(value.toString());
-    } else if (name == Roaming) {
-        Q_EMIT roamingChanged(value.toBool());
-    } else if (name == Timeservers) {
-        Q_EMIT timeserversChanged(value.toStringList());
-    } else if (name == TimeserversConfig) {
-        Q_EMIT timeserversConfigChanged(value.toStringList());
-    } else if (name == BSSID) {
-        Q_EMIT bssidChanged(value.toString());
-    } else if (name == MaxRate) {
-        Q_EMIT maxRateChanged(value.toUInt());
-    } else if (name == Frequency) {
-        Q_EMIT frequencyChanged(value.toUInt());
-    } else if (name == EncryptionMode) {
-        Q_EMIT encryptionModeChanged(value.toString());
-    } else if (name == Hidden) {
-        Q_EMIT hiddenChanged(value.toBool());
+        break;
+    case TypeProperty:
+        Q_EMIT typeChanged(p.type);
+        break;
+    case SecurityProperty:
+        Q_EMIT securityChanged(p.security);
+        break;
+    case StrengthProperty:
+        Q_EMIT strengthChanged(p.strength);
+        break;
+    case ErrorProperty:
+        Q_EMIT errorChanged(p.error);
+        break;
+    case FavoriteProperty:
+        Q_EMIT favoriteChanged(p.favorite);
+        break;
+    case AutoConnectProperty:
+        Q_EMIT autoConnectChanged(p.autoConnect);
+        break;
+    case IPv4Property:
+        Q_EMIT ipv4Changed(p.ipv4);
+        break;
+    case IPv4ConfigProperty:
+        Q_EMIT ipv4ConfigChanged(p.ipv4Config);
+        break;
+    case IPv6Property:
+        Q_EMIT ipv6Changed(p.ipv6);
+        break;
+    case IPv6ConfigProperty:
+        Q_EMIT ipv6ConfigChanged(p.ipv6Config);
+        break;
+    case NameserversProperty:
+        Q_EMIT nameserversChanged(p.nameservers);
+        break;
+    case NameserversConfigProperty:
+        Q_EMIT nameserversConfigChanged(p.nameserversConfig);
+        break;
+    case DomainsProperty:
+        Q_EMIT domainsChanged(p.domains);
+        break;
+    case DomainsConfigProperty:
+        Q_EMIT domainsConfigChanged(p.domainsConfig);
+        break;
+    case ProxyProperty:
+        Q_EMIT proxyChanged(p.proxy);
+        break;
+    case ProxyConfigProperty:
+        Q_EMIT proxyConfigChanged(p.proxyConfig);
+        break;
+    case EthernetProperty:
+        Q_EMIT ethernetChanged(p.ethernet);
+        break;
+    case RoamingProperty:
+        Q_EMIT roamingChanged(p.roaming);
+        break;
+    case TimeserversProperty:
+        Q_EMIT timeserversChanged(p.timeservers);
+        break;
+    case TimeserversConfigProperty:
+        Q_EMIT timeserversConfigChanged(p.timeserversConfig);
+        break;
+    case BSSIDProperty:
+        Q_EMIT bssidChanged(p.bssid);
+        break;
+    case MaxRateProperty:
+        Q_EMIT maxRateChanged(p.maxRate);
+        break;
+    case FrequencyProperty:
+        Q_EMIT frequencyChanged(p.frequency);
+        break;
+    case EncryptionModeProperty:
+        Q_EMIT encryptionModeChanged(p.encryptionMode);
+        break;
+    case HiddenProperty:
+        Q_EMIT hiddenChanged(p.hidden);
+        break;
     }
 }
 
+void NetworkService::emitPropertyChange(const QString &name, const QVariant &value)
+{
+    const int id = propertyId(name);
+    if (id < 0) {
+        if (m_propertiesCache.value(name) != value) {
+            m_propertiesCache[name] = value;
+            if (m_coalesceChanges && !m_dirtyUnknownProperties.contains(name)) {
+                m_dirtyUnknownProperties.append(name);
+                schedulePropertyFlush();
+            }
+        }
+        return;
+    }
+
+    if (!storeProperty(id, value))
+        return;
+
+    if (m_coalesceChanges) {
+        m_dirtyProperties |= 1u << id;
+        schedulePropertyFlush();
+    } else {
+        emitPropertySignal(id);
+    }
+}
+
+void NetworkService::schedulePropertyFlush()
+{
+    if (!m_coalesceTimer) {
+        m_coalesceTimer = new QTimer(this);
+        m_coalesceTimer->setSingleShot(true);
+        m_coalesceTimer->setInterval(m_coalesceInterval);
+        connect(m_coalesceTimer, SIGNAL(timeout()), this, SLOT(flushPropertyChanges()));
+    }
+
+    // not restarted on purpose, a steady stream of changes still gets
+    // flushed once per interval
+    if (!m_coalesceTimer->isActive())
+        m_coalesceTimer->start();
+}
+
+void NetworkService::flushPropertyChanges()
+{
+    if (m_coalesceTimer)
+        m_coalesceTimer->stop();
+
+    const quint32 dirty = m_dirtyProperties;
+    QStringList names = m_dirtyUnknownProperties;
+
+    m_dirtyProperties = 0;
+    m_dirtyUnknownProperties.clear();
+
+    for (int id = 0; id < PropertyCount; ++id) {
+        if (dirty & (1u << id)) {
+            emitPropertySignal(id);
+            names.append(propertyNames().at(id));
+        }
+    }
+
+    if (!names.isEmpty())
+        Q_EMIT propertiesChanged(names);
+}
+
 void NetworkService::getPropertiesFinished(QDBusPendingCallWatcher *call)
 {
     QDBusPendingReply<QVariantMap> reply = *call;
@@ -562,7 +748,6 @@ void NetworkService::updateProperty(const QString &name, const QDBusVariant &val
 {
     QVariant tmp = value.variant();
 
-    Q_ASSERT(m_service);
     emitPropertyChange(name,tmp);
 }
 
@@ -575,12 +760,47 @@ void NetworkService::updateProperties(const QVariantMap &properties)
     Q_EMIT propertiesReady();
 }
 
+/*
+ * Takes over a complete property set, as for a service coming back into
+ * range. Properties missing from it are reset, the others only signal if
+ * their value changed.
+ */
+void NetworkService::replaceProperties(const QVariantMap &properties)
+{
+    quint32 stale = m_knownProperties;
+    QVariantMap::const_iterator it = properties.constBegin(), end = properties.constEnd();
+    for ( ; it != end; ++it) {
+        const int id = propertyId(it.key());
+        if (id >= 0)
+            stale &= ~(1u << id);
+    }
+
+    for (int id = 0; id < PropertyCount; ++id) {
+        if (!(stale & (1u << id)))
+            continue;
+
+        storeProperty(id, QVariant());
+        m_knownProperties &= ~(1u << id);
+
+        if (m_coalesceChanges) {
+            m_dirtyProperties |= 1u << id;
+            schedulePropertyFlush();
+        } else {
+            emitPropertySignal(id);
+        }
+    }
+    m_propertiesCache.clear();
+
+    updateProperties(properties);
+}
+
 void NetworkService::setPath(const QString &path)
 {
     if (path == m_path)
         return;
 
-    m_path = path;
+    m_path = StringPool::intern(path);
+    m_managed = false;
     emit pathChanged(m_path);
 
     resetProperties();
@@ -590,6 +810,24 @@ void NetworkService::setPath(const QString &path)
     if (!m_service || !m_service->isValid())
         return;
 
+    // Take the properties from the manager's copy if it has one
+    NetworkManager *manager = NetworkManagerFactory::existingInstance();
+    NetworkService *known = manager ? manager->cachedService(path) : NULL;
+    if (known && known != this && known->m_knownProperties) {
+        copyProperties(*known);
+        manager->propertyFetchSaved();
+        Q_EMIT propertiesReady();
+        return;
+    }
+
+    refreshProperties();
+}
+
+void NetworkService::refreshProperties()
+{
+    if (!serviceInterface())
+        return;
+
     QDBusPendingReply<QVariantMap> reply = m_service->GetProperties();
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
 
@@ -597,60 +835,103 @@ void NetworkService::setPath(const QString &path)
             this, SLOT(getPropertiesFinished(QDBusPendingCallWatcher*)));
 }
 
-bool NetworkService::connected()
+void NetworkService::copyProperties(const NetworkService &other)
 {
-    if (m_propertiesCache && m_propertiesCache.contains(State)) {
-        QString state = m_propertiesCache.value(State).toString();
-        if (state == "online" || state == "ready")
-            return true;
+    m_properties = other.m_properties;
+    m_knownProperties = other.m_knownProperties;
+    m_propertiesCache = other.m_propertiesCache;
+
+    if (m_coalesceChanges) {
+        m_dirtyProperties |= m_knownProperties;
+        if (m_knownProperties)
+            schedulePropertyFlush();
+        return;
     }
-    return false;
+
+    for (int id = 0; id < PropertyCount; ++id) {
+        if (m_knownProperties & (1u << id))
+            emitPropertySignal(id);
+    }
+}
+
+bool NetworkService::connected()
+{
+    return m_properties.stateId == StringPool::OnlineState
+            || m_properties.stateId == StringPool::ReadyState;
 }
 
 QStringList NetworkService::timeservers() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Timeservers))
-        return m_propertiesCache.value(Timeservers).toStringList();
-    return QStringList();
+    return m_properties.timeservers;
 }
 
 QStringList NetworkService::timeserversConfig() const
 {
-    if (m_propertiesCache && m_propertiesCache.contains(TimeserversConfig))
-        return m_propertiesCache.value(TimeserversConfig).toStringList();
-    return QStringList();
+    return m_properties.timeserversConfig;
 }
 
 void NetworkService::setTimeserversConfig(const QStringList &servers)
 {
-    if (m_service)
+    if (serviceInterface())
         m_service->SetProperty(TimeserversConfig, QDBusVariant(QVariant(servers)));
 }
 
 const QString NetworkService::bssid()
 {
-    if (m_propertiesCache && m_propertiesCache.contains(BSSID))
-        return m_propertiesCache.value(BSSID).toString();
-    return QString();
+    return m_properties.bssid;
 }
 
 quint32 NetworkService::maxRate()
 {
-    if (m_propertiesCache && m_propertiesCache.contains(MaxRate))
-        return m_propertiesCache.value(MaxRate).toUInt();
-    return 0;
+    return m_properties.maxRate;
 }
 
 quint16 NetworkService::frequency()
 {
-    if (m_propertiesCache && m_propertiesCache.contains(Frequency))
-        return m_propertiesCache.value(Frequency).toUInt();
-    return 0;
+    return m_properties.frequency;
 }
 
 const QString NetworkService::encryptionMode()
 {
-    if (m_propertiesCache && m_propertiesCache.contains(EncryptionMode))
-        return m_propertiesCache.value(EncryptionMode).toString();
-    return QString();
+    return m_properties.encryptionMode;
+}
+
+bool NetworkService::coalesceChanges() const
+{
+    return m_coalesceChanges;
+}
+
+/*
+ * With coalescing enabled the change signals are not emitted as the
+ * properties arrive. They are collected and emitted at most once per
+ * property every coalesceInterval milliseconds (0 meaning the next
+ * event loop iteration), followed by a single propertiesChanged().
+ */
+void NetworkService::setCoalesceChanges(bool coalesce)
+{
+    if (m_coalesceChanges == coalesce)
+        return;
+
+    m_coalesceChanges = coalesce;
+    if (!m_coalesceChanges)
+        flushPropertyChanges();
+
+    Q_EMIT coalesceChangesChanged(m_coalesceChanges);
+}
+
+int NetworkService::coalesceInterval() const
+{
+    return m_coalesceInterval;
+}
+
+void NetworkService::setCoalesceInterval(int interval)
+{
+    if (interval < 0 || m_coalesceInterval == interval)
+        return;
+
+    m_coalesceInterval = interval;
+    if (m_coalesceTimer)
+        m_coalesceTimer->setInterval(m_coalesceInterval);
+
+    Q_EMIT coalesceIntervalChanged(m_coalesceInterval);
 }
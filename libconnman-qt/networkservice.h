@@ -12,18 +12,25 @@
 #define NETWORKSERVICE_H
 
 #include <QtDBus>
+#include "stringpool.h"
 
 #define CONNECT_TIMEOUT 180000 // user is supposed to provide input for unconfigured networks
 #define CONNECT_TIMEOUT_FAVORITE 60000
 
 class NetConnmanServiceInterface;
 
+namespace Tests {
+    class UtManager;
+    class UtService;
+}
+
 class NetworkService : public QObject
 {
     Q_OBJECT
 
     Q_PROPERTY(QString name READ name NOTIFY nameChanged)
     Q_PROPERTY(QString state READ state NOTIFY stateChanged)
+    Q_PROPERTY(ServiceState serviceState READ serviceState NOTIFY serviceStateChanged)
     Q_PROPERTY(QString type READ type NOTIFY typeChanged)
     Q_PROPERTY(QString error READ error NOTIFY errorChanged)
     Q_PROPERTY(QStringList security READ security NOTIFY securityChanged)
@@ -53,7 +60,27 @@ class NetworkService : public QObject
     Q_PROPERTY(QString encryptionMode READ encryptionMode NOTIFY encryptionModeChanged)
     Q_PROPERTY(bool hidden READ hidden NOTIFY hiddenChanged)
 
+    Q_PROPERTY(bool coalesceChanges READ coalesceChanges WRITE setCoalesceChanges NOTIFY coalesceChangesChanged)
+    Q_PROPERTY(int coalesceInterval READ coalesceInterval WRITE setCoalesceInterval NOTIFY coalesceIntervalChanged)
+
+    Q_ENUMS(ServiceState)
+
+    friend class Tests::UtManager;
+    friend class Tests::UtService;
+
 public:
+    /* The connman states, "state" holds the same as string */
+    enum ServiceState {
+        UnknownState = StringPool::UnknownState,
+        IdleState = StringPool::IdleState,
+        FailureState = StringPool::FailureState,
+        AssociationState = StringPool::AssociationState,
+        ConfigurationState = StringPool::ConfigurationState,
+        ReadyState = StringPool::ReadyState,
+        DisconnectState = StringPool::DisconnectState,
+        OnlineState = StringPool::OnlineState
+    };
+
     NetworkService(const QString &path, const QVariantMap &properties, QObject* parent);
     NetworkService(QObject* parent = 0);
 
@@ -62,6 +89,7 @@ public:
     const QString name() const;
     const QString type() const;
     const QString state() const;
+    ServiceState serviceState() const;
     const QString error() const;
     const QStringList security() const;
     bool autoConnect() const;
@@ -95,9 +123,18 @@ public:
     const QString encryptionMode();
     bool hidden() const;
 
+    bool coalesceChanges() const;
+    void setCoalesceChanges(bool coalesce);
+    int coalesceInterval() const;
+    void setCoalesceInterval(int interval);
+
+    /* The connman property names kept decoded, see commondbustypes.cpp */
+    static const QStringList &propertyNames();
+
 Q_SIGNALS:
     void nameChanged(const QString &name);
     void stateChanged(const QString &state);
+    void serviceStateChanged(NetworkService::ServiceState state);
     void errorChanged(const QString &error);
     void securityChanged(const QStringList &security);
     void strengthChanged(const uint strength);
@@ -133,6 +170,11 @@ Q_SIGNALS:
     void encryptionModeChanged(const QString &mode);
     void hiddenChanged(bool);
 
+    /* Only emitted with coalesceChanges set, after the individual change signals */
+    void propertiesChanged(const QStringList &names);
+    void coalesceChangesChanged(bool coalesce);
+    void coalesceIntervalChanged(int interval);
+
 public Q_SLOTS:
     void requestConnect();
     void requestDisconnect();
@@ -146,12 +188,94 @@ public Q_SLOTS:
     void setProxyConfig(const QVariantMap &proxy);
 
     void resetCounters();
+    void refreshProperties();
 
 private:
+    enum PropertyId {
+        NameProperty,
+        StateProperty,
+        TypeProperty,
+        SecurityProperty,
+        StrengthProperty,
+        ErrorProperty,
+        FavoriteProperty,
+        AutoConnectProperty,
+        IPv4Property,
+        IPv4ConfigProperty,
+        IPv6Property,
+        IPv6ConfigProperty,
+        NameserversProperty,
+        NameserversConfigProperty,
+        DomainsProperty,
+        DomainsConfigProperty,
+        ProxyProperty,
+        ProxyConfigProperty,
+        EthernetProperty,
+        RoamingProperty,
+        TimeserversProperty,
+        TimeserversConfigProperty,
+        BSSIDProperty,
+        MaxRateProperty,
+        FrequencyProperty,
+        EncryptionModeProperty,
+        HiddenProperty,
+        PropertyCount
+    };
+
+    /*
+     * Already decoded values of the properties listed in PropertyId. State
+     * and type are interned, the state with its enum value next to it.
+     */
+    struct Properties {
+        Properties();
+
+        StringPool::State stateId;
+        QString name;
+        QString state;
+        QString type;
+        QString error;
+        QString bssid;
+        QString encryptionMode;
+        QStringList security;
+        QStringList nameservers;
+        QStringList nameserversConfig;
+        QStringList domains;
+        QStringList domainsConfig;
+        QStringList timeservers;
+        QStringList timeserversConfig;
+        QVariantMap ipv4;
+        QVariantMap ipv4Config;
+        QVariantMap ipv6;
+        QVariantMap ipv6Config;
+        QVariantMap proxy;
+        QVariantMap proxyConfig;
+        QVariantMap ethernet;
+        uint strength;
+        quint32 maxRate;
+        quint16 frequency;
+        bool favorite;
+        bool autoConnect;
+        bool roaming;
+        bool hidden;
+    };
+
     NetConnmanServiceInterface *m_service;
     QString m_path;
+    Properties m_properties;
+    /* Bit mask of PropertyId values received from connman */
+    quint32 m_knownProperties;
+    /* Properties this class doesn't know about */
     QVariantMap m_propertiesCache;
 
+    bool m_coalesceChanges;
+    int m_coalesceInterval;
+    QTimer *m_coalesceTimer;
+    quint32 m_dirtyProperties;
+    QStringList m_dirtyUnknownProperties;
+
+    /* Owned by NetworkManager, which also delivers PropertyChanged */
+    bool m_managed;
+
     static const QString Name;
     static const QString State;
     static const QString Type;
@@ -191,10 +315,24 @@ private Q_SLOTS:
     void handleConnectReply(QDBusPendingCallWatcher *call);
     void handleRemoveReply(QDBusPendingCallWatcher *watcher);
     void handleAutoConnectReply(QDBusPendingCallWatcher*);
+    void flushPropertyChanges();
 
 private:
+    static int propertyId(const QString &name);
+    bool storeProperty(int id, const QVariant &value);
+    void emitPropertySignal(int id);
+    void invalidateManagerBuckets();
+    void schedulePropertyFlush();
     void resetProperties();
+    void copyProperties(const NetworkService &other);
+    void replaceProperties(const QVariantMap &properties);
     void reconnectServiceInterface();
+    NetConnmanServiceInterface *serviceInterface();
+
+    NetworkService(const QString &path, const QVariantMap &properties, QObject* parent, bool managed);
+    void init(const QVariantMap &properties);
+
+    friend class NetworkManager;
 
     Q_DISABLE_COPY(NetworkService)
 };
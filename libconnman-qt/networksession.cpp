@@ -26,6 +26,7 @@ void NetworkSession::createSession()
 {
     if (m_path.isEmpty())
         return;
+    const int pending = pendingChanges();
     if (m_sessionAgent) {
         delete m_sessionAgent;
         m_sessionAgent = 0;
@@ -33,6 +34,18 @@ void NetworkSession::createSession()
     m_sessionAgent = new SessionAgent(m_path ,this);
     connect(m_sessionAgent,SIGNAL(settingsUpdated(QVariantMap)),
             this,SLOT(sessionSettingsUpdated(QVariantMap)));
+    connect(m_sessionAgent,SIGNAL(changeFailed(QString,QString)),
+            this,SIGNAL(changeFailed(QString,QString)));
+    connect(m_sessionAgent,SIGNAL(pendingChangesChanged(int)),
+            this,SIGNAL(pendingChangesChanged(int)));
+
+    if (pending != pendingChanges())
+        Q_EMIT pendingChangesChanged(pendingChanges());
+}
+
+int NetworkSession::pendingChanges() const
+{
+    return m_sessionAgent ? m_sessionAgent->pendingChanges() : 0;
 }
 
 QString NetworkSession::state() const
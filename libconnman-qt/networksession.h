@@ -35,6 +35,8 @@ class NetworkSession : public QObject
     Q_PROPERTY(QStringList allowedBearers READ allowedBearers WRITE setAllowedBearers NOTIFY allowedBearersChanged)
     Q_PROPERTY(QString connectionType READ connectionType WRITE setConnectionType NOTIFY connectionTypeChanged)
 
+    Q_PROPERTY(int pendingChanges READ pendingChanges NOTIFY pendingChangesChanged)
+
     friend class Tests::UtSession;
 
 public:
@@ -53,6 +55,8 @@ public:
 
     QString path() const;
 
+    int pendingChanges() const;
+
     void setAllowedBearers(const QStringList &bearers);
     void setConnectionType(const QString &type);
 
@@ -60,6 +64,8 @@ Q_SIGNALS:
     void allowedBearersChanged(const QStringList &bearers);
     void connectionTypeChanged(const QString &type);
     void settingsChanged(const QVariantMap &settings);
+    void changeFailed(const QString &name, const QString &error);
+    void pendingChangesChanged(int pendingChanges);
 
     void stateChanged(const QString &state);
     void nameChanged(const QString &name);
@@ -8,8 +8,12 @@
  *
  */
 
+#include <QTimer>
+
 #include "networktechnology.h"
+#include "networkmanager.h"
 #include "connman_technology_interface.h"
+#include "stringpool.h"
 
 const QString NetworkTechnology::Name("Name");
 const QString NetworkTechnology::Type("Type");
@@ -20,31 +24,145 @@ const QString NetworkTechnology::Tethering("Tethering");
 const QString NetworkTechnology::TetheringIdentifier("TetheringIdentifier");
 const QString NetworkTechnology::TetheringPassphrase("TetheringPassphrase");
 
+/*
+ * Counters of the scans measured so far. The latencies of the last
+ * HistorySize scans are also kept bucketed, as a rolling histogram.
+ */
+struct NetworkTechnology::ScanMetrics
+{
+    enum {
+        HistorySize = 32,
+        BucketCount = 8,
+        SettleTime = 1000 // [ms]
+    };
+
+    ScanMetrics();
+
+    static int bucket(int latency);
+    void addLatency(int latency);
+
+    int scans;
+    int errors;
+    int added;
+    int removed;
+    int updated;
+
+    // The scan being measured, until the first ServicesChanged after its
+    // reply or SettleTime after it, whichever comes first
+    bool measuring;
+    bool replied;
+    QTimer settle;
+    int latency;
+    int scanAdded;
+    int scanRemoved;
+    int scanUpdated;
+
+    int history[HistorySize];
+    int historyCount;
+    int historyNext;
+    int buckets[BucketCount];
+};
+
+namespace {
+
+// Upper bounds of the latency buckets, the last one takes everything above
+const int scanLatencyBounds[] = {
+    250, 500, 1000, 2000, 4000, 8000, 16000 // [ms]
+};
+
+}
+
+NetworkTechnology::ScanMetrics::ScanMetrics()
+    : scans(0),
+      errors(0),
+      added(0),
+      removed(0),
+      updated(0),
+      measuring(false),
+      replied(false),
+      latency(0),
+      scanAdded(0),
+      scanRemoved(0),
+      scanUpdated(0),
+      historyCount(0),
+      historyNext(0)
+{
+    for (int i = 0; i < BucketCount; ++i)
+        buckets[i] = 0;
+
+    settle.setSingleShot(true);
+    settle.setInterval(SettleTime);
+}
+
+int NetworkTechnology::ScanMetrics::bucket(int latency)
+{
+    int i = 0;
+    while (i < BucketCount - 1 && latency >= scanLatencyBounds[i])
+        ++i;
+    return i;
+}
+
+void NetworkTechnology::ScanMetrics::addLatency(int latency)
+{
+    if (historyCount == HistorySize)
+        --buckets[bucket(history[historyNext])];
+    else
+        ++historyCount;
+
+    history[historyNext] = latency;
+    historyNext = (historyNext + 1) % HistorySize;
+    ++buckets[bucket(latency)];
+}
+
 NetworkTechnology::NetworkTechnology(const QString &path, const QVariantMap &properties, QObject* parent)
   : QObject(parent),
     m_technology(NULL),
-    m_path(QString())
+    m_path(QString()),
+    m_scanning(false),
+    m_scanAnswerPending(false),
+    m_servicesChanged(false),
+    m_powerSave(false),
+    m_scanInterval(MinScanInterval),
+    m_lastScanDuration(0),
+    m_lastScanResults(0),
+    m_scanMetrics(NULL)
 {
     Q_ASSERT(!path.isEmpty());
     m_propertiesCache = properties;
     init(path);
+
+    // Only ask when the creator did not know the properties, still
+    // reporting ready once the creator can connect to it
+    if (m_propertiesCache.isEmpty())
+        refreshProperties();
+    else
+        QMetaObject::invokeMethod(this, "propertiesReady", Qt::QueuedConnection);
 }
 
 NetworkTechnology::NetworkTechnology(QObject* parent)
     : QObject(parent),
       m_technology(NULL),
-      m_path(QString())
+      m_path(QString()),
+      m_scanning(false),
+      m_scanAnswerPending(false),
+      m_servicesChanged(false),
+      m_powerSave(false),
+      m_scanInterval(MinScanInterval),
+      m_lastScanDuration(0),
+      m_lastScanResults(0),
+      m_scanMetrics(NULL)
 {
 }
 
 NetworkTechnology::~NetworkTechnology()
 {
+    delete m_scanMetrics;
 }
 
 void NetworkTechnology::init(const QString &path)
 {
     if (path != m_path) {
-        m_path = path;
+        m_path = StringPool::intern(path);
 
         if (m_technology) {
             delete m_technology;
@@ -61,12 +179,6 @@ void NetworkTechnology::init(const QString &path)
             qFatal("Cannot init with invalid technology");
         }
 
-        QDBusPendingReply<QVariantMap> reply = m_technology->GetProperties();
-        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-
-        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
-                this, SLOT(getPropertiesFinished(QDBusPendingCallWatcher*)));
-
         connect(m_technology,
                 SIGNAL(PropertyChanged(const QString&, const QDBusVariant&)),
                 this,
@@ -80,14 +192,29 @@ void NetworkTechnology::getPropertiesFinished(QDBusPendingCallWatcher *call)
     QDBusPendingReply<QVariantMap> reply = *call;
     call->deleteLater();
 
-    if (!reply.isError()) {
+    if (!reply.isError())
+        updateProperties(reply.value());
+}
 
-        m_propertiesCache = reply.value();
-        Q_FOREACH(const QString &name,m_propertiesCache.keys()) {
-            emitPropertyChange(name,m_propertiesCache[name]);
-        }
-        Q_EMIT propertiesReady();
+void NetworkTechnology::updateProperties(const QVariantMap &properties)
+{
+    m_propertiesCache = properties;
+    Q_FOREACH(const QString &name,m_propertiesCache.keys()) {
+        emitPropertyChange(name,m_propertiesCache[name]);
     }
+    Q_EMIT propertiesReady();
+}
+
+void NetworkTechnology::refreshProperties()
+{
+    if (!m_technology)
+        return;
+
+    QDBusPendingReply<QVariantMap> reply = m_technology->GetProperties();
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(getPropertiesFinished(QDBusPendingCallWatcher*)));
 }
 
 // Public API
@@ -146,27 +273,143 @@ void NetworkTechnology::scan()
     if (!m_technology)
         return;
 
+    // Answered when the scan in flight finishes
+    if (m_scanning)
+        return;
+
+    if (m_lastScan.isValid() && m_lastScan.elapsed() < m_scanInterval) {
+        if (!m_scanAnswerPending) {
+            m_scanAnswerPending = true;
+            QMetaObject::invokeMethod(this, "answerScan", Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    if (m_scanMetrics) {
+        if (m_scanMetrics->measuring)
+            finishScanMeasurement();
+        m_scanMetrics->measuring = true;
+    }
+
+    m_scanning = true;
+    m_servicesChanged = false;
+    m_scanStarted.start();
+
     QDBusPendingReply<> reply = m_technology->Scan();
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
     connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
             this, SLOT(scanReply(QDBusPendingCallWatcher*)));
 }
 
+bool NetworkTechnology::powerSave() const
+{
+    return m_powerSave;
+}
+
+void NetworkTechnology::setPowerSave(bool powerSave)
+{
+    if (m_powerSave == powerSave)
+        return;
+
+    m_powerSave = powerSave;
+    m_scanInterval = qBound(minScanInterval(), m_scanInterval, maxScanInterval());
+    Q_EMIT powerSaveChanged(m_powerSave);
+}
+
+int NetworkTechnology::lastScanDuration() const
+{
+    return m_lastScanDuration;
+}
+
+int NetworkTechnology::lastScanResults() const
+{
+    return m_lastScanResults;
+}
+
+bool NetworkTechnology::scanMetricsEnabled() const
+{
+    return m_scanMetrics != NULL;
+}
+
+void NetworkTechnology::setScanMetricsEnabled(bool enabled)
+{
+    if (enabled == scanMetricsEnabled())
+        return;
+
+    if (enabled) {
+        m_scanMetrics = new ScanMetrics;
+        connect(&m_scanMetrics->settle, SIGNAL(timeout()), this, SLOT(scanSettled()));
+    } else {
+        delete m_scanMetrics;
+        m_scanMetrics = NULL;
+    }
+    Q_EMIT scanMetricsChanged();
+}
+
+QVariantMap NetworkTechnology::scanMetrics() const
+{
+    QVariantMap metrics;
+    if (!m_scanMetrics)
+        return metrics;
+
+    const ScanMetrics &m = *m_scanMetrics;
+
+    QVariantList bounds;
+    QVariantList histogram;
+    for (int i = 0; i < ScanMetrics::BucketCount; ++i) {
+        if (i < ScanMetrics::BucketCount - 1)
+            bounds.append(scanLatencyBounds[i]);
+        histogram.append(m.buckets[i]);
+    }
+
+    metrics.insert(QLatin1String("scans"), m.scans);
+    metrics.insert(QLatin1String("errors"), m.errors);
+    metrics.insert(QLatin1String("servicesAdded"), m.added);
+    metrics.insert(QLatin1String("servicesRemoved"), m.removed);
+    metrics.insert(QLatin1String("servicesUpdated"), m.updated);
+    metrics.insert(QLatin1String("latencyBounds"), bounds);
+    metrics.insert(QLatin1String("latencyHistogram"), histogram);
+    return metrics;
+}
+
 // Private
+int NetworkTechnology::propertyId(const QString &name)
+{
+    static QHash<QString, int> ids;
+    if (ids.isEmpty()) { // init once
+        ids.insert(Name, NameProperty);
+        ids.insert(Type, TypeProperty);
+        ids.insert(Powered, PoweredProperty);
+        ids.insert(Connected, ConnectedProperty);
+        ids.insert(IdleTimeout, IdleTimeoutProperty);
+        ids.insert(Tethering, TetheringProperty);
+        ids.insert(TetheringIdentifier, TetheringIdentifierProperty);
+        ids.insert(TetheringPassphrase, TetheringPassphraseProperty);
+    }
+    return ids.value(name, -1);
+}
+
 void NetworkTechnology::emitPropertyChange(const QString &name, const QVariant &value)
 {
-    if (name == Powered) {
+    switch (propertyId(name)) {
+    case PoweredProperty:
         Q_EMIT poweredChanged(value.toBool());
-    } else if (name == Connected) {
+        break;
+    case ConnectedProperty:
         Q_EMIT connectedChanged(value.toBool());
-    } else if (name == IdleTimeout) {
-      Q_EMIT idleTimeoutChanged(value.toUInt());
-    } else if (name == Tethering) {
-      Q_EMIT tetheringChanged(value.toBool());
-    } else if (name == TetheringIdentifier) {
-      Q_EMIT tetheringIdChanged(value.toString());
-    } else if (name == TetheringPassphrase) {
-      Q_EMIT tetheringPassphraseChanged(value.toString());
+        break;
+    case IdleTimeoutProperty:
+        Q_EMIT idleTimeoutChanged(value.toUInt());
+        break;
+    case TetheringProperty:
+        Q_EMIT tetheringChanged(value.toBool());
+        break;
+    case TetheringIdentifierProperty:
+        Q_EMIT tetheringIdChanged(value.toString());
+        break;
+    case TetheringPassphraseProperty:
+        Q_EMIT tetheringPassphraseChanged(value.toString());
+        break;
     }
 }
 
@@ -180,13 +423,159 @@ void NetworkTechnology::propertyChanged(const QString &name, const QDBusVariant
     emitPropertyChange(name,tmp);
 }
 
+/*
+ * Scans come quickly after one another while services keep appearing or
+ * disappearing, each scan which changed nothing doubles the interval. Only
+ * the manager's own technologies hear of service changes, the others keep
+ * the shortest interval.
+ */
 void NetworkTechnology::scanReply(QDBusPendingCallWatcher *call)
 {
+    m_scanning = false;
+    m_lastScanDuration = m_scanStarted.elapsed();
+    m_lastScan.start();
+
+    NetworkManager *manager = NetworkManagerFactory::existingInstance();
+    const bool managed = manager && manager->cachedTechnology(m_path) == this;
+
+    if (m_scanMetrics && m_scanMetrics->measuring) {
+        m_scanMetrics->latency = m_lastScanDuration;
+        m_scanMetrics->replied = true;
+
+        // Service changes only reach the manager's own technologies, and
+        // connman sends none when the scan found nothing new
+        if (call->isError())
+            finishScanMeasurement(call->error().name());
+        else if (!managed)
+            finishScanMeasurement();
+        else
+            m_scanMetrics->settle.start();
+    }
+
+    // The manager's own ones count the results once its ServicesChanged is in
+    if (!managed)
+        setLastScanResults(manager ? manager->getServices(type()).count() : 0);
+
+    // A failed scan tells nothing about how busy the air is
+    if (m_servicesChanged || !managed)
+        m_scanInterval = minScanInterval();
+    else if (!call->isError())
+        m_scanInterval = qMin(m_scanInterval * 2, maxScanInterval());
+    m_servicesChanged = false;
+
     Q_EMIT scanFinished();
 
     call->deleteLater();
 }
 
+void NetworkTechnology::answerScan()
+{
+    m_scanAnswerPending = false;
+    Q_EMIT scanFinished();
+}
+
+// Called by NetworkManager for each service of this type in ServicesChanged
+void NetworkTechnology::serviceListChanged(ServiceChange change)
+{
+    if (change != ServiceUpdated) {
+        m_servicesChanged = true;
+        m_scanInterval = minScanInterval();
+    }
+
+    if (!m_scanMetrics || !m_scanMetrics->measuring)
+        return;
+
+    switch (change) {
+    case ServiceAdded:
+        ++m_scanMetrics->scanAdded;
+        break;
+    case ServiceRemoved:
+        ++m_scanMetrics->scanRemoved;
+        break;
+    case ServiceUpdated:
+        ++m_scanMetrics->scanUpdated;
+        break;
+    }
+}
+
+// Called by NetworkManager once it has gone through a ServicesChanged
+void NetworkTechnology::serviceListUpdated()
+{
+    if (m_scanning || m_lastScan.isValid()) {
+        NetworkManager *manager = NetworkManagerFactory::existingInstance();
+        setLastScanResults(manager->getServices(type()).count());
+    }
+
+    if (m_scanMetrics && m_scanMetrics->replied)
+        finishScanMeasurement();
+}
+
+void NetworkTechnology::scanSettled()
+{
+    if (m_scanMetrics && m_scanMetrics->replied)
+        finishScanMeasurement();
+}
+
+/*
+ * Books the scan being measured. A scan without a reply yet, because the
+ * next one started, is dropped.
+ */
+void NetworkTechnology::finishScanMeasurement(const QString &error)
+{
+    ScanMetrics &m = *m_scanMetrics;
+    const bool replied = m.replied;
+
+    if (replied) {
+        ++m.scans;
+        if (!error.isEmpty())
+            ++m.errors;
+        m.added += m.scanAdded;
+        m.removed += m.scanRemoved;
+        m.updated += m.scanUpdated;
+        m.addLatency(m.latency);
+
+        if (receivers(SIGNAL(scanMeasured(QVariantMap))) > 0) {
+            QVariantMap record;
+            record.insert(QLatin1String("type"), type());
+            record.insert(QLatin1String("latency"), m.latency);
+            record.insert(QLatin1String("error"), error);
+            record.insert(QLatin1String("servicesAdded"), m.scanAdded);
+            record.insert(QLatin1String("servicesRemoved"), m.scanRemoved);
+            record.insert(QLatin1String("servicesUpdated"), m.scanUpdated);
+            Q_EMIT scanMeasured(record);
+        }
+    }
+
+    m.settle.stop();
+    m.measuring = false;
+    m.replied = false;
+    m.scanAdded = 0;
+    m.scanRemoved = 0;
+    m.scanUpdated = 0;
+
+    if (replied)
+        Q_EMIT scanMetricsChanged();
+}
+
+void NetworkTechnology::setLastScanResults(int results)
+{
+    if (m_lastScanResults == results)
+        return;
+
+    m_lastScanResults = results;
+    Q_EMIT lastScanResultsChanged(m_lastScanResults);
+}
+
+int NetworkTechnology::minScanInterval() const
+{
+    return m_powerSave ? PowerSaveMinScanInterval : MinScanInterval;
+}
+
+int NetworkTechnology::maxScanInterval() const
+{
+    return m_powerSave ? PowerSaveMaxScanInterval : MaxScanInterval;
+}
+
 QString NetworkTechnology::path() const
 {
     return m_path;
@@ -196,6 +585,16 @@ void NetworkTechnology::setPath(const QString &path)
 {
     if (path != m_path && !path.isEmpty()) {
         init(path);
+
+        // Take the properties from the manager's copy if it has one
+        NetworkManager *manager = NetworkManagerFactory::existingInstance();
+        NetworkTechnology *known = manager ? manager->cachedTechnology(path) : NULL;
+        if (known && known != this && !known->m_propertiesCache.isEmpty()) {
+            updateProperties(known->m_propertiesCache);
+            manager->propertyFetchSaved();
+        } else {
+            refreshProperties();
+        }
     }
 }
 
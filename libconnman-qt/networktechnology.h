@@ -12,9 +12,14 @@
 #define NETWORKTECHNOLOGY_H
 
 #include <QtDBus>
+#include <QElapsedTimer>
 
 class NetConnmanTechnologyInterface;
 
+namespace Tests {
+    class UtTechnology;
+}
+
 class NetworkTechnology : public QObject
 {
     Q_OBJECT
@@ -30,6 +35,14 @@ class NetworkTechnology : public QObject
     Q_PROPERTY(QString tetheringId READ tetheringId WRITE setTetheringId NOTIFY tetheringIdChanged)
     Q_PROPERTY(QString tetheringPassphrase READ tetheringPassphrase WRITE setTetheringPassphrase NOTIFY tetheringPassphraseChanged)
 
+    Q_PROPERTY(bool powerSave READ powerSave WRITE setPowerSave NOTIFY powerSaveChanged)
+    Q_PROPERTY(int lastScanDuration READ lastScanDuration NOTIFY scanFinished)
+    Q_PROPERTY(int lastScanResults READ lastScanResults NOTIFY lastScanResultsChanged)
+    Q_PROPERTY(bool scanMetricsEnabled READ scanMetricsEnabled WRITE setScanMetricsEnabled NOTIFY scanMetricsChanged)
+    Q_PROPERTY(QVariantMap scanMetrics READ scanMetrics NOTIFY scanMetricsChanged)
+
+    friend class Tests::UtTechnology;
+
 public:
     NetworkTechnology(const QString &path, const QVariantMap &properties, QObject* parent);
     NetworkTechnology(QObject* parent=0);
@@ -56,11 +69,21 @@ public:
     QString tetheringPassphrase() const;
     void setTetheringPassphrase(const QString &pass);
 
+    bool powerSave() const;
+    void setPowerSave(bool powerSave);
+    int lastScanDuration() const;
+    int lastScanResults() const;
+
+    bool scanMetricsEnabled() const;
+    void setScanMetricsEnabled(bool enabled);
+    QVariantMap scanMetrics() const;
+
 
 public Q_SLOTS:
     void setPowered(const bool &powered);
     void scan();
     void setPath(const QString &path);
+    void refreshProperties();
 
 Q_SIGNALS:
     void poweredChanged(const bool &powered);
@@ -72,8 +95,26 @@ Q_SIGNALS:
     void tetheringPassphraseChanged(const QString &passphrase);
     void pathChanged(const QString &path);
     void propertiesReady();
+    void powerSaveChanged(bool powerSave);
+    void lastScanResultsChanged(int results);
+    void scanMetricsChanged();
+    /* One record per measured scan, only built if something is connected */
+    void scanMeasured(const QVariantMap &record);
 
 private:
+    enum PropertyId {
+        NameProperty,
+        TypeProperty,
+        PoweredProperty,
+        ConnectedProperty,
+        IdleTimeoutProperty,
+        TetheringProperty,
+        TetheringIdentifierProperty,
+        TetheringPassphraseProperty
+    };
+
+    static int propertyId(const QString &name);
+
     NetConnmanTechnologyInterface *m_technology;
     QVariantMap m_propertiesCache;
 
@@ -88,6 +129,43 @@ private:
 
     QString m_path;
     void init(const QString &path);
+    void updateProperties(const QVariantMap &properties);
+
+    enum {
+        MinScanInterval = 2000, // [ms]
+        MaxScanInterval = 30000,
+        PowerSaveMinScanInterval = 10000,
+        PowerSaveMaxScanInterval = 120000
+    };
+
+    enum ServiceChange {
+        ServiceAdded,
+        ServiceRemoved,
+        ServiceUpdated
+    };
+
+    struct ScanMetrics;
+
+    void serviceListChanged(ServiceChange change);
+    void serviceListUpdated();
+    void finishScanMeasurement(const QString &error = QString());
+    void setLastScanResults(int results);
+    int minScanInterval() const;
+    int maxScanInterval() const;
+
+    /* Scans are spaced by m_scanInterval, requests in between get the last results */
+    bool m_scanning;
+    bool m_scanAnswerPending;
+    bool m_servicesChanged;
+    bool m_powerSave;
+    int m_scanInterval;
+    int m_lastScanDuration;
+    int m_lastScanResults;
+    QElapsedTimer m_scanStarted;
+    QElapsedTimer m_lastScan;
+
+    /* Only allocated while scan metrics are enabled */
+    ScanMetrics *m_scanMetrics;
 
 
 private Q_SLOTS:
@@ -95,9 +173,13 @@ private Q_SLOTS:
     void emitPropertyChange(const QString &name, const QVariant &value);
 
     void scanReply(QDBusPendingCallWatcher *call);
+    void answerScan();
+    void scanSettled();
     void getPropertiesFinished(QDBusPendingCallWatcher *call);
 
 private:
+    friend class NetworkManager;
+
     Q_DISABLE_COPY(NetworkTechnology)
 };
 
@@ -0,0 +1,493 @@
+/*
+ * Copyright © 2012, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "routemonitor.h"
+
+#include <QSocketNotifier>
+#include <QDebug>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+namespace {
+
+/*
+ * Line reader for the /proc route tables working on a stack buffer,
+ * so that rescanning does not allocate.
+ */
+class ProcLineReader
+{
+public:
+    explicit ProcLineReader(const char *path) :
+        m_fd(::open(path, O_RDONLY | O_CLOEXEC)),
+        m_start(0),
+        m_end(0)
+    {
+    }
+
+    ~ProcLineReader()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    bool isOpen() const { return m_fd >= 0; }
+
+    char *readLine()
+    {
+        for (;;) {
+            char *newline = static_cast<char *>(memchr(m_buffer + m_start, '\n', m_end - m_start));
+            if (newline) {
+                *newline = '\0';
+                char *line = m_buffer + m_start;
+                m_start = newline - m_buffer + 1;
+                return line;
+            }
+
+            if (m_start > 0) {
+                memmove(m_buffer, m_buffer + m_start, m_end - m_start);
+                m_end -= m_start;
+                m_start = 0;
+            }
+
+            ssize_t count = 0;
+            if (m_end < int(sizeof(m_buffer)) - 1)
+                count = ::read(m_fd, m_buffer + m_end, sizeof(m_buffer) - 1 - m_end);
+
+            if (count <= 0) {
+                // last line without a newline, or one that does not fit
+                if (m_end > m_start) {
+                    m_buffer[m_end] = '\0';
+                    m_start = m_end = 0;
+                    return m_buffer;
+                }
+                return NULL;
+            }
+            m_end += count;
+        }
+    }
+
+private:
+    int m_fd;
+    int m_start;
+    int m_end;
+    char m_buffer[512];
+};
+
+// Splits line in place on whitespace, returns the number of fields found
+int splitFields(char *line, char **fields, int max)
+{
+    int count = 0;
+    char *p = line;
+    while (count < max) {
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        if (*p == '\0')
+            break;
+        fields[count++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+            ++p;
+        if (*p == '\0')
+            break;
+        *p++ = '\0';
+    }
+    return count;
+}
+
+bool isZero(const char *field)
+{
+    while (*field == '0')
+        ++field;
+    return *field == '\0';
+}
+
+bool parseHex(const char *field, unsigned long *value)
+{
+    char *end = NULL;
+    *value = strtoul(field, &end, 16);
+    return end != field && *end == '\0';
+}
+
+void copyName(char *name, const char *source)
+{
+    strncpy(name, source, IFNAMSIZ - 1);
+    name[IFNAMSIZ - 1] = '\0';
+}
+
+const char *const Ipv4RouteTable = "/proc/net/route";
+const char *const Ipv6RouteTable = "/proc/net/ipv6_route";
+
+/*
+ * Finds the default route from the IPv4 table, falling back to the IPv6
+ * one. Lowest metric wins within each table.
+ */
+bool scanProcRoutes(char *name, const char *ipv4Table, const char *ipv6Table)
+{
+    char *fields[11];
+    unsigned long bestMetric = 0;
+    bool found = false;
+
+    ProcLineReader ipv4(ipv4Table);
+    if (ipv4.isOpen()) {
+        // Iface Destination Gateway Flags RefCnt Use Metric Mask MTU Window IRTT
+        while (char *line = ipv4.readLine()) {
+            if (splitFields(line, fields, 11) < 11)
+                continue;
+
+            unsigned long flags, metric;
+            if (!parseHex(fields[3], &flags) || !parseHex(fields[6], &metric))
+                continue;
+
+            const bool gatewayRoute = isZero(fields[1]) && isZero(fields[7])
+                    && (flags & (RTF_UP | RTF_GATEWAY)) == (RTF_UP | RTF_GATEWAY);
+            const bool pppRoute = strncmp(fields[0], "ppp", 3) == 0 && flags == RTF_UP;
+
+            if ((gatewayRoute || pppRoute) && (!found || metric < bestMetric)) {
+                copyName(name, fields[0]);
+                bestMetric = metric;
+                found = true;
+            }
+        }
+    }
+
+    if (found)
+        return true;
+
+    ProcLineReader ipv6(ipv6Table);
+    if (ipv6.isOpen()) {
+        // Destination Prefix Source Prefix NextHop Metric RefCnt Use Flags Iface
+        while (char *line = ipv6.readLine()) {
+            if (splitFields(line, fields, 10) < 10)
+                continue;
+
+            unsigned long prefix, flags, metric;
+            if (!parseHex(fields[1], &prefix) || !parseHex(fields[5], &metric)
+                    || !parseHex(fields[8], &flags))
+                continue;
+
+            if (isZero(fields[0]) && prefix == 0 && (flags & RTF_UP) && !(flags & RTF_REJECT)
+                    && (!found || metric < bestMetric)) {
+                copyName(name, fields[9]);
+                bestMetric = metric;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+}
+
+RouteMonitor::RouteMonitor(QObject *parent) :
+    QObject(parent),
+    m_socket(-1),
+    m_notifier(NULL),
+    m_sequence(0),
+    m_dumping(false),
+    m_dumpPending(false)
+{
+    // Seed synchronously so that defaultInterface() is valid right away,
+    // the netlink dump will confirm it once the event loop runs.
+    char name[IFNAMSIZ];
+    if (scanProcRoutes(name, Ipv4RouteTable, Ipv6RouteTable))
+        m_defaultInterface = QString::fromLatin1(name);
+
+    if (openSocket()) {
+        requestDump();
+        if (!m_dumping)
+            closeSocket();
+    }
+}
+
+RouteMonitor::~RouteMonitor()
+{
+    closeSocket();
+}
+
+QString RouteMonitor::defaultInterface() const
+{
+    return m_defaultInterface;
+}
+
+bool RouteMonitor::isMonitoring() const
+{
+    return m_socket >= 0;
+}
+
+/*
+ * With netlink a fresh dump resynchronizes the route table, otherwise the
+ * /proc tables are read again. defaultInterfaceChanged() is emitted only
+ * if the default interface is different.
+ */
+void RouteMonitor::rescan()
+{
+    if (isMonitoring()) {
+        requestDump();
+        return;
+    }
+
+    char name[IFNAMSIZ];
+    if (!scanProcRoutes(name, Ipv4RouteTable, Ipv6RouteTable))
+        name[0] = '\0';
+    setDefaultInterface(name);
+}
+
+QString RouteMonitor::scanRouteTables(const char *ipv4Table, const char *ipv6Table)
+{
+    char name[IFNAMSIZ];
+    if (!scanProcRoutes(name, ipv4Table, ipv6Table))
+        return QString();
+    return QString::fromLatin1(name);
+}
+
+bool RouteMonitor::openSocket()
+{
+    m_socket = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (m_socket < 0) {
+        qWarning() << "RouteMonitor: netlink unavailable:" << strerror(errno);
+        return false;
+    }
+
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    // Link events too, IPv4 routes vanish silently when their device goes down
+    address.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+
+    if (::bind(m_socket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        qWarning() << "RouteMonitor: cannot bind netlink socket:" << strerror(errno);
+        closeSocket();
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(readMessages()));
+    return true;
+}
+
+void RouteMonitor::closeSocket()
+{
+    delete m_notifier;
+    m_notifier = NULL;
+
+    if (m_socket >= 0) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+    m_dumping = false;
+    m_dumpPending = false;
+}
+
+void RouteMonitor::requestDump()
+{
+    // Only one dump can run per socket, queue another one behind it
+    if (m_dumping) {
+        m_dumpPending = true;
+        return;
+    }
+
+    struct {
+        struct nlmsghdr header;
+        struct rtmsg message;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    request.header.nlmsg_type = RTM_GETROUTE;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++m_sequence;
+    request.message.rtm_family = AF_UNSPEC;
+
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    if (::sendto(m_socket, &request, request.header.nlmsg_len, 0,
+                 reinterpret_cast<struct sockaddr *>(&kernel), sizeof(kernel)) < 0) {
+        qWarning() << "RouteMonitor: route dump failed:" << strerror(errno);
+        return;
+    }
+
+    m_routes.clear();
+    m_dumping = true;
+    m_dumpPending = false;
+}
+
+void RouteMonitor::readMessages()
+{
+    union {
+        struct nlmsghdr header;
+        char data[8192];
+    } buffer;
+
+    for (;;) {
+        const ssize_t length = ::recv(m_socket, buffer.data, sizeof(buffer.data), 0);
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                // Events were dropped, the table has to be read again
+                m_dumping = false;
+                requestDump();
+                continue;
+            }
+            break;
+        }
+        if (length == 0)
+            break;
+
+        handleMessages(buffer.data, int(length));
+    }
+
+    if (!m_dumping)
+        updateDefaultInterface();
+}
+
+void RouteMonitor::handleMessages(char *buffer, int length)
+{
+    for (struct nlmsghdr *header = reinterpret_cast<struct nlmsghdr *>(buffer);
+         NLMSG_OK(header, (unsigned int)length);
+         header = NLMSG_NEXT(header, length)) {
+
+        switch (header->nlmsg_type) {
+        case NLMSG_DONE:
+        case NLMSG_ERROR:
+            if (m_dumping && header->nlmsg_seq == m_sequence) {
+                m_dumping = false;
+                if (m_dumpPending)
+                    requestDump();
+            }
+            break;
+
+        case RTM_NEWLINK:
+        case RTM_DELLINK: {
+            const struct ifinfomsg *info = static_cast<const struct ifinfomsg *>(NLMSG_DATA(header));
+            if (header->nlmsg_type == RTM_DELLINK || !(info->ifi_flags & IFF_UP))
+                removeRoutes(info->ifi_index);
+            break;
+        }
+
+        case RTM_DELADDR:
+            // The kernel flushes routes using the address without telling
+            requestDump();
+            break;
+
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE: {
+            const struct rtmsg *message = static_cast<const struct rtmsg *>(NLMSG_DATA(header));
+            if (message->rtm_dst_len != 0 || message->rtm_type != RTN_UNICAST)
+                break;
+            if (message->rtm_family != AF_INET && message->rtm_family != AF_INET6)
+                break;
+
+            Route route;
+            route.family = message->rtm_family;
+            route.index = 0;
+            route.metric = 0;
+            int table = message->rtm_table;
+            int nexthopIndex = 0;
+
+            int attributesLength = RTM_PAYLOAD(header);
+            for (const struct rtattr *attribute = RTM_RTA(message);
+                 RTA_OK(attribute, attributesLength);
+                 attribute = RTA_NEXT(attribute, attributesLength)) {
+                switch (attribute->rta_type) {
+                case RTA_OIF:
+                    route.index = *static_cast<const int *>(RTA_DATA(attribute));
+                    break;
+                case RTA_PRIORITY:
+                    route.metric = *static_cast<const quint32 *>(RTA_DATA(attribute));
+                    break;
+                case RTA_TABLE:
+                    table = *static_cast<const quint32 *>(RTA_DATA(attribute));
+                    break;
+                case RTA_MULTIPATH:
+                    // Multipath routes go by the interface of their first hop
+                    if (RTA_PAYLOAD(attribute) >= int(sizeof(struct rtnexthop))) {
+                        const struct rtnexthop *nexthop =
+                                static_cast<const struct rtnexthop *>(RTA_DATA(attribute));
+                        nexthopIndex = nexthop->rtnh_ifindex;
+                    }
+                    break;
+                }
+            }
+
+            if (route.index == 0)
+                route.index = nexthopIndex;
+            if (table != RT_TABLE_MAIN || route.index == 0)
+                break;
+
+            // A replacing route takes the place of the one with its metric
+            const bool replace = header->nlmsg_type == RTM_NEWROUTE
+                    && (header->nlmsg_flags & NLM_F_REPLACE);
+
+            int i = 0;
+            for (; i < m_routes.count(); ++i) {
+                const Route &existing = m_routes.at(i);
+                if (existing.family == route.family && existing.metric == route.metric
+                        && (replace || existing.index == route.index))
+                    break;
+            }
+
+            if (header->nlmsg_type == RTM_NEWROUTE) {
+                if (i == m_routes.count())
+                    m_routes.append(route);
+                else
+                    m_routes[i] = route;
+            } else if (i < m_routes.count()) {
+                m_routes.remove(i);
+            }
+            break;
+        }
+        }
+    }
+}
+
+void RouteMonitor::removeRoutes(int index)
+{
+    for (int i = m_routes.count() - 1; i >= 0; --i) {
+        if (m_routes.at(i).index == index)
+            m_routes.remove(i);
+    }
+}
+
+void RouteMonitor::updateDefaultInterface()
+{
+    // IPv4 default routes take precedence, then the lowest metric
+    const Route *best = NULL;
+    for (int i = 0; i < m_routes.count(); ++i) {
+        const Route &route = m_routes.at(i);
+        if (!best || (route.family == AF_INET && best->family != AF_INET)
+                || (route.family == best->family && route.metric < best->metric))
+            best = &route;
+    }
+
+    char name[IFNAMSIZ];
+    if (!best || !if_indextoname(best->index, name))
+        name[0] = '\0';
+    setDefaultInterface(name);
+}
+
+void RouteMonitor::setDefaultInterface(const char *interfaceName)
+{
+    if (m_defaultInterface == QLatin1String(interfaceName))
+        return;
+
+    m_defaultInterface = QString::fromLatin1(interfaceName);
+    Q_EMIT defaultInterfaceChanged(m_defaultInterface);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright © 2012, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef ROUTEMONITOR_H
+#define ROUTEMONITOR_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class QSocketNotifier;
+
+namespace Tests {
+    class UtRouteMonitor;
+}
+
+/*
+ * Keeps track of the network interface holding the default route.
+ *
+ * Route changes are followed through rtnetlink where available. Without
+ * netlink, isMonitoring() is false and the route table has to be re-read
+ * with rescan(), which scans /proc/net/route and /proc/net/ipv6_route.
+ */
+class RouteMonitor : public QObject
+{
+    Q_OBJECT
+
+    friend class Tests::UtRouteMonitor;
+
+public:
+    explicit RouteMonitor(QObject *parent = 0);
+    virtual ~RouteMonitor();
+
+    QString defaultInterface() const;
+    bool isMonitoring() const;
+
+    /* The default route interface in route tables of the /proc format */
+    static QString scanRouteTables(const char *ipv4Table, const char *ipv6Table);
+
+public Q_SLOTS:
+    void rescan();
+
+Q_SIGNALS:
+    void defaultInterfaceChanged(const QString &interfaceName);
+
+private:
+    struct Route {
+        int family;
+        int index;
+        quint32 metric;
+    };
+
+    bool openSocket();
+    void closeSocket();
+    void requestDump();
+    void handleMessages(char *buffer, int length);
+    void removeRoutes(int index);
+    void updateDefaultInterface();
+    void setDefaultInterface(const char *interfaceName);
+
+    int m_socket;
+    QSocketNotifier *m_notifier;
+    quint32 m_sequence;
+    bool m_dumping;
+    bool m_dumpPending;
+    QVector<Route> m_routes;
+    QString m_defaultInterface;
+
+private Q_SLOTS:
+    void readMessages();
+
+private:
+    Q_DISABLE_COPY(RouteMonitor)
+};
+
+#endif // ROUTEMONITOR_H
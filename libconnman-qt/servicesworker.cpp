@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "servicesworker.h"
+#include "connman_manager_interface.h"
+
+ServicesWorker::ServicesWorker()
+    : QObject(0),
+      m_manager(NULL)
+{
+}
+
+ServicesWorker::~ServicesWorker()
+{
+}
+
+// Must be invoked on the worker's own thread
+void ServicesWorker::start()
+{
+    if (m_manager)
+        return;
+
+    m_manager = new NetConnmanManagerInterface("net.connman", "/",
+            QDBusConnection::systemBus(), this);
+
+    connect(m_manager, SIGNAL(ServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)),
+            this, SLOT(onServicesChanged(ConnmanObjectList,QList<QDBusObjectPath>)));
+    QDBusConnection::systemBus().connect("net.connman", QString(), "net.connman.Service",
+            "PropertyChanged", this, SLOT(onServicePropertyChanged(QString,QDBusVariant,QDBusMessage)));
+
+    QDBusPendingReply<ConnmanObjectList> reply = m_manager->GetServices();
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(getServicesFinished(QDBusPendingCallWatcher*)));
+}
+
+void ServicesWorker::onServicesChanged(const ConnmanObjectList &changed,
+                                       const QList<QDBusObjectPath> &removed)
+{
+    QStringList removedPaths;
+    removedPaths.reserve(removed.count());
+    Q_FOREACH (const QDBusObjectPath &path, removed)
+        removedPaths.append(path.path());
+
+    Q_EMIT servicesChanged(changed, removedPaths);
+}
+
+void ServicesWorker::getServicesFinished(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<ConnmanObjectList> reply = *watcher;
+    watcher->deleteLater();
+    if (reply.isError())
+        return;
+
+    Q_EMIT servicesReceived(reply.value());
+}
+
+void ServicesWorker::onServicePropertyChanged(const QString &name, const QDBusVariant &value,
+                                              const QDBusMessage &message)
+{
+    Q_EMIT servicePropertyChanged(message.path(), name, value.variant());
+}
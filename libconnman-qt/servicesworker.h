@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef SERVICESWORKER_H
+#define SERVICESWORKER_H
+
+#include <QObject>
+#include <QStringList>
+#include "commondbustypes.h"
+
+class NetConnmanManagerInterface;
+
+/*
+ * Lives on NetworkManager's D-Bus thread, see NetworkManager::dbusThreadEnabled.
+ * Receives and decodes the service lists of net.connman.Manager off the
+ * GUI thread and passes them on ready to use, together with the property
+ * changes of the services so that those stay in order with the lists.
+ */
+class ServicesWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ServicesWorker();
+    virtual ~ServicesWorker();
+
+public Q_SLOTS:
+    void start();
+
+Q_SIGNALS:
+    void servicesChanged(const ConnmanObjectList &changed, const QStringList &removed);
+    void servicesReceived(const ConnmanObjectList &services);
+    void servicePropertyChanged(const QString &servicePath, const QString &name,
+                                const QVariant &value);
+
+private Q_SLOTS:
+    void onServicesChanged(const ConnmanObjectList &changed, const QList<QDBusObjectPath> &removed);
+    void getServicesFinished(QDBusPendingCallWatcher *watcher);
+    void onServicePropertyChanged(const QString &name, const QDBusVariant &value,
+                                  const QDBusMessage &message);
+
+private:
+    NetConnmanManagerInterface *m_manager;
+
+    Q_DISABLE_COPY(ServicesWorker)
+};
+
+#endif // SERVICESWORKER_H
@@ -27,8 +27,17 @@ SessionAgent::SessionAgent(const QString &path, QObject* parent) :
     QObject(parent),
     agentPath(path),
     m_manager(NetworkManagerFactory::createInstance()),
-    m_session(0)
+    m_session(0),
+    m_state(NoSession),
+    m_createWatcher(0),
+    m_pendingChanges(0),
+    m_pendingRequest(NoRequest)
 {
+    connect(m_manager, SIGNAL(availabilityChanged(bool)),
+            this, SLOT(managerAvailabilityChanged(bool)));
+
+    new SessionNotificationAdaptor(this);
+
     m_manager->setSessionMode(true);
     createSession();
 }
@@ -41,68 +50,199 @@ SessionAgent::~SessionAgent()
 
 void SessionAgent::setAllowedBearers(const QStringList &bearers)
 {
-    if (!m_session)
+    change("AllowedBearers", qVariantFromValue(bearers));
+}
+
+void SessionAgent::setConnectionType(const QString &type)
+{
+    change("ConnectionType", qVariantFromValue(type));
+}
+
+/*
+ * Change calls are pipelined. While one is on its way for a key, only
+ * the latest newer value of that key is kept and sent after it.
+ */
+void SessionAgent::change(const QString &name, const QVariant &value)
+{
+    // key() gives a null watcher if nothing is on its way for name
+    if (m_state != SessionReady || m_changesInFlight.key(name))
+        m_pendingSettings.insert(name, value);
+    else
+        sendChange(name, value);
+
+    updatePendingChanges();
+}
+
+void SessionAgent::sendChange(const QString &name, const QVariant &value)
+{
+    QDBusPendingReply<> reply = m_session->Change(name, QDBusVariant(value));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(onChangeFinished(QDBusPendingCallWatcher*)));
+    m_changesInFlight.insert(watcher, name);
+}
+
+int SessionAgent::pendingChanges() const
+{
+    return m_pendingChanges;
+}
+
+void SessionAgent::updatePendingChanges()
+{
+    const int pending = m_pendingSettings.count() + m_changesInFlight.count();
+    if (pending != m_pendingChanges) {
+        m_pendingChanges = pending;
+        Q_EMIT pendingChangesChanged(m_pendingChanges);
+    }
+}
+
+/*
+ * Asks connman for the session without waiting for it. Changes and
+ * requests made in the meantime are applied in order once the session
+ * exists, see sessionCreated().
+ */
+void SessionAgent::createSession()
+{
+    if (m_state != NoSession)
+        return;
+
+    if (!m_manager->isAvailable()) {
+        qDebug() << Q_FUNC_INFO << "manager not valid";
         return;
-    QVariantMap map;
-    map.insert("AllowedBearers",  qVariantFromValue(bearers));
-    QDBusPendingReply<> reply = m_session->Change("AllowedBearers",QDBusVariant(bearers));
-    // hope this is not a lengthy task
-    reply.waitForFinished();
-    if (reply.isError()) {
-        qDebug() << Q_FUNC_INFO << reply.error();
     }
 
+    // connman may call us as soon as the session is there
+    registerAgent();
+
+    QDBusPendingReply<QDBusObjectPath> reply = m_manager->createSessionAsync(QVariantMap(), agentPath);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(onCreateSessionFinished(QDBusPendingCallWatcher*)));
+
+    m_createWatcher = watcher;
+    m_state = CreatingSession;
 }
 
-void SessionAgent::setConnectionType(const QString &type)
+void SessionAgent::registerAgent()
 {
-    if (!m_session)
-        return;
-    QVariantMap map;
-    map.insert("ConnectionType",  qVariantFromValue(type));
-    m_session->Change("ConnectionType",QDBusVariant(type));
+    QDBusConnection::systemBus().unregisterObject(agentPath);
+    if (!QDBusConnection::systemBus().registerObject(agentPath, this)) {
+        qDebug() << "Could not register agent object";
+    }
 }
 
-void SessionAgent::createSession()
+void SessionAgent::onCreateSessionFinished(QDBusPendingCallWatcher *call)
 {
-    if (m_manager->isAvailable()) {
-        QDBusObjectPath obpath = m_manager->createSession(QVariantMap(),agentPath);
-        if (!obpath.path().isEmpty()) {
-            m_session = new NetConnmanSessionInterface("net.connman", obpath.path(),
-                QDBusConnection::systemBus(), this);
-            new SessionNotificationAdaptor(this);
-            QDBusConnection::systemBus().unregisterObject(agentPath);
-            if (!QDBusConnection::systemBus().registerObject(agentPath, this)) {
-                qDebug() << "Could not register agent object";
-            }
-        } else {
+    QDBusPendingReply<QDBusObjectPath> reply = *call;
+    call->deleteLater();
+
+    // Asked again since, when connman went away and came back meanwhile
+    if (call != m_createWatcher) {
+        if (!reply.isError() && !reply.value().path().isEmpty())
+            destroyStaleSession(reply.value());
+        return;
+    }
+    m_createWatcher = 0;
+
+    if (reply.isError() || reply.value().path().isEmpty()) {
+        if (reply.isError())
+            qDebug() << reply.error().message();
+        else
             qDebug() << "agentPath is not valid" << agentPath;
-        }
+        m_state = NoSession;
+        return;
+    }
+
+    const QDBusObjectPath sessionPath = reply.value();
+    m_session = new NetConnmanSessionInterface("net.connman", sessionPath.path(),
+        QDBusConnection::systemBus(), this);
+    m_state = SessionReady;
+
+    Q_EMIT sessionCreated(sessionPath);
+
+    flushPendingRequests();
+}
+
+void SessionAgent::destroyStaleSession(const QDBusObjectPath &path)
+{
+    NetConnmanSessionInterface session("net.connman", path.path(),
+                                       QDBusConnection::systemBus());
+    session.Destroy();
+}
+
+void SessionAgent::flushPendingRequests()
+{
+    QVariantMap settings;
+    settings.swap(m_pendingSettings);
+
+    QVariantMap::const_iterator it = settings.constBegin(), end = settings.constEnd();
+    for ( ; it != end; ++it)
+        change(it.key(), it.value());
+    updatePendingChanges();
+
+    const PendingRequest request = m_pendingRequest;
+    m_pendingRequest = NoRequest;
+
+    switch (request) {
+    case ConnectRequest:
+        requestConnect();
+        break;
+    case DisconnectRequest:
+        requestDisconnect();
+        break;
+    case DestroyRequest:
+        requestDestroy();
+        break;
+    case NoRequest:
+        break;
+    }
+}
+
+void SessionAgent::managerAvailabilityChanged(bool available)
+{
+    if (available) {
+        createSession();
     } else {
-        qDebug() << Q_FUNC_INFO << "manager not valid";
+        delete m_session;
+        m_session = 0;
+        m_createWatcher = 0;
+        m_state = NoSession;
     }
 }
 
 void SessionAgent::requestConnect()
 {
-    if (m_session) {
-      QDBusPendingReply<> reply = m_session->Connect();
-      QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
-      connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
-          this, SLOT(onConnectFinished(QDBusPendingCallWatcher*)));
+    if (m_state != SessionReady) {
+        m_pendingRequest = ConnectRequest;
+        return;
     }
+
+    QDBusPendingReply<> reply = m_session->Connect();
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(reply, this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+        this, SLOT(onConnectFinished(QDBusPendingCallWatcher*)));
 }
 
 void SessionAgent::requestDisconnect()
 {
-    if (m_session)
-        m_session->Disconnect();
+    if (m_state != SessionReady) {
+        m_pendingRequest = DisconnectRequest;
+        return;
+    }
+
+    m_session->Disconnect();
 }
 
 void SessionAgent::requestDestroy()
 {
-    if (m_session)
-        m_session->Destroy();
+    if (m_state != SessionReady) {
+        m_pendingSettings.clear();
+        m_pendingRequest = DestroyRequest;
+        updatePendingChanges();
+        return;
+    }
+
+    m_session->Destroy();
 }
 
 void SessionAgent::release()
@@ -124,6 +264,23 @@ void SessionAgent::onConnectFinished(QDBusPendingCallWatcher *call)
   call->deleteLater();
 }
 
+void SessionAgent::onChangeFinished(QDBusPendingCallWatcher *call)
+{
+    QDBusPendingReply<> reply = *call;
+    call->deleteLater();
+
+    const QString name = m_changesInFlight.take(call);
+    if (reply.isError()) {
+        qDebug() << Q_FUNC_INFO << name << reply.error();
+        Q_EMIT changeFailed(name, reply.error().message());
+    }
+
+    if (m_state == SessionReady && m_pendingSettings.contains(name))
+        sendChange(name, m_pendingSettings.take(name));
+
+    updatePendingChanges();
+}
+
 SessionNotificationAdaptor::SessionNotificationAdaptor(SessionAgent* parent)
   : QDBusAbstractAdaptor(parent),
     m_sessionAgent(parent)
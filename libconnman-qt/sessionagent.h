@@ -28,6 +28,8 @@ public:
     void requestDisconnect();
     void requestDestroy();
 
+    int pendingChanges() const;
+
 public Q_SLOTS:
     void release();
     void update(const QVariantMap &settings);
@@ -36,15 +38,50 @@ public Q_SLOTS:
 Q_SIGNALS:
     void settingsUpdated(const QVariantMap &settings);
     void released();
+    void sessionCreated(const QDBusObjectPath &path);
+    void changeFailed(const QString &name, const QString &error);
+    void pendingChangesChanged(int pendingChanges);
 
 private Q_SLOTS:
     void onConnectFinished(QDBusPendingCallWatcher *watcher);
+    void onChangeFinished(QDBusPendingCallWatcher *watcher);
+    void onCreateSessionFinished(QDBusPendingCallWatcher *watcher);
+    void managerAvailabilityChanged(bool available);
 
 private:
+    /* Requests made before the session exists wait in the Pending* members */
+    enum SessionState {
+        NoSession,
+        CreatingSession,
+        SessionReady
+    };
+
+    enum PendingRequest {
+        NoRequest,
+        ConnectRequest,
+        DisconnectRequest,
+        DestroyRequest
+    };
+
+    void change(const QString &name, const QVariant &value);
+    void sendChange(const QString &name, const QVariant &value);
+    void updatePendingChanges();
+    void registerAgent();
+    void destroyStaleSession(const QDBusObjectPath &path);
+    void flushPendingRequests();
+
     QString agentPath;
     QVariantMap sessionSettings;
     NetworkManager* m_manager;
     NetConnmanSessionInterface *m_session;
+    SessionState m_state;
+    /* The CreateSession call whose reply is adopted, others are stale */
+    QDBusPendingCallWatcher *m_createWatcher;
+    QVariantMap m_pendingSettings;
+    /* At most one Change per key is on the bus, newer values wait above */
+    QHash<QDBusPendingCallWatcher *, QString> m_changesInFlight;
+    int m_pendingChanges;
+    PendingRequest m_pendingRequest;
 
     friend class SessionNotificationAdaptor;
 };
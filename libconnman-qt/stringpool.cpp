@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "stringpool.h"
+
+#include <QMutex>
+#include <QSet>
+#include <QVector>
+
+namespace {
+
+const char *const stateNames[] = {
+    "", "idle", "failure", "association", "configuration", "ready",
+    "disconnect", "online"
+};
+
+/*
+ * The set owns one reference to each string. Strings nobody else refers
+ * to any more are dropped whenever the set has doubled since the last
+ * sweep, so paths of services which are long gone don't pile up.
+ */
+class Pool
+{
+public:
+    Pool()
+        : m_sweepSize(64)
+    {
+        for (unsigned i = 0; i < sizeof(stateNames) / sizeof(stateNames[0]); ++i)
+            m_states.append(*m_strings.insert(QLatin1String(stateNames[i])));
+    }
+
+    QString intern(const QString &string)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        QSet<QString>::const_iterator it = m_strings.constFind(string);
+        if (it != m_strings.constEnd())
+            return *it;
+
+        if (m_strings.count() >= m_sweepSize)
+            sweep();
+        return *m_strings.insert(string);
+    }
+
+    int count()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_strings.count();
+    }
+
+    int indexOf(const QVector<QString> &names, const QString &name) const
+    {
+        // Interned names match on the data pointer alone
+        for (int i = 1; i < names.count(); ++i) {
+            if (names.at(i).constData() == name.constData())
+                return i;
+        }
+        for (int i = 1; i < names.count(); ++i) {
+            if (names.at(i) == name)
+                return i;
+        }
+        return 0;
+    }
+
+    QVector<QString> m_states;
+
+private:
+    void sweep()
+    {
+        QSet<QString>::iterator it = m_strings.begin();
+        while (it != m_strings.end()) {
+            if (it->isDetached())
+                it = m_strings.erase(it);
+            else
+                ++it;
+        }
+        m_sweepSize = qMax(64, m_strings.count() * 2);
+    }
+
+    QMutex m_mutex;
+    QSet<QString> m_strings;
+    int m_sweepSize;
+};
+
+Pool *pool()
+{
+    static Pool instance;
+    return &instance;
+}
+
+} // namespace
+
+QString StringPool::intern(const QString &string)
+{
+    if (string.isEmpty())
+        return QString();
+    return pool()->intern(string);
+}
+
+StringPool::State StringPool::state(const QString &name)
+{
+    Pool *p = pool();
+    return static_cast<State>(p->indexOf(p->m_states, name));
+}
+
+int StringPool::size()
+{
+    return pool()->count();
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+namespace Tests {
+    class UtService;
+}
+
+/*
+ * Process wide pool of the strings connman keeps repeating. Interned
+ * strings share their data, so an object path or a state is stored once
+ * however many objects hold it. Service states also map to enum values,
+ * which can be compared instead of the strings.
+ */
+class StringPool
+{
+    friend class Tests::UtService;
+
+public:
+    enum State {
+        UnknownState,
+        IdleState,
+        FailureState,
+        AssociationState,
+        ConfigurationState,
+        ReadyState,
+        DisconnectState,
+        OnlineState
+    };
+
+    static QString intern(const QString &string);
+
+    static State state(const QString &name);
+
+private:
+    StringPool();
+
+    static int size();
+};
+
+#endif // STRINGPOOL_H
@@ -0,0 +1,688 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "usagestore.h"
+#include "counter.h"
+#include "stringpool.h"
+#include "counterusage_p.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QVector>
+#include <QDebug>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace CounterUsage;
+
+namespace {
+
+const char Magic[4] = { 'C', 'U', 'S', 'G' };
+
+enum {
+    Version = 1,
+    MaxServices = 128,
+    PathLength = 184,
+    InitialCapacity = 4096
+};
+
+enum {
+    ReplacedFlag = 0x1
+};
+
+const qint64 Retention = 62 * DayLength;
+
+/*
+ * The file is a header, a table of service paths and the records. Records
+ * and service slots are written before the counts covering them are, so a
+ * reader only ever looks at complete entries.
+ */
+struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 recordSize;
+    volatile quint32 flags;
+    quint32 capacity;
+    volatile quint32 count;
+    volatile quint32 serviceCount;
+    quint32 reserved;
+};
+
+struct Slot {
+    char path[PathLength];
+    volatile qint32 last[2]; // newest record, home and roaming, or -1
+};
+
+struct Record {
+    qint64 timestamp;
+    quint64 rx;
+    quint64 tx;
+    quint32 seconds;
+    quint16 service;
+    quint16 roaming;
+};
+
+const size_t SlotsOffset = sizeof(Header);
+const size_t RecordsOffset = SlotsOffset + MaxServices * sizeof(Slot);
+
+size_t fileSize(quint32 capacity)
+{
+    return RecordsOffset + size_t(capacity) * sizeof(Record);
+}
+
+quint64 valueOf(const QVariantMap &counters, const QString &key, quint64 previous)
+{
+    QVariantMap::const_iterator it = counters.constFind(key);
+    return it == counters.constEnd() ? previous : it.value().toULongLong();
+}
+
+// Compaction keeps the last sample per minute, hour or day depending on age
+qint64 bucketOf(qint64 timestamp, qint64 now)
+{
+    const qint64 age = now - timestamp;
+    const qint64 length = age < HourLength ? MinuteLength
+                        : age < 2 * DayLength ? HourLength
+                        : DayLength;
+    return timestamp / length;
+}
+
+bool isReset(const Record &record, const Record &next)
+{
+    return next.rx < record.rx || next.tx < record.tx || next.seconds < record.seconds;
+}
+
+// Starts the file over, dropping whatever it held
+bool initialize(int fd, quint32 capacity)
+{
+    if (::ftruncate(fd, 0) < 0 || ::ftruncate(fd, fileSize(capacity)) < 0)
+        return false;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.recordSize = sizeof(Record);
+    header.capacity = capacity;
+    return ::pwrite(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header));
+}
+
+}
+
+struct UsageStore::Mapping
+{
+    Mapping() : fd(-1), data(NULL), size(0), writable(false) {}
+
+    ~Mapping()
+    {
+        if (data)
+            ::munmap(data, size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    Header *header() const { return reinterpret_cast<Header *>(data); }
+    Slot *serviceSlots() const { return reinterpret_cast<Slot *>(data + SlotsOffset); }
+    Record *records() const { return reinterpret_cast<Record *>(data + RecordsOffset); }
+
+    int count() const
+    {
+        const int count = header()->count;
+        __sync_synchronize();
+        return count;
+    }
+
+    // Timestamp of the newest record of a service, 0 without any
+    qint64 lastSeen(int service) const
+    {
+        const Slot &slot = serviceSlots()[service];
+        qint64 timestamp = 0;
+        for (int roaming = 0; roaming < 2; ++roaming) {
+            if (slot.last[roaming] >= 0)
+                timestamp = qMax(timestamp, records()[slot.last[roaming]].timestamp);
+        }
+        return timestamp;
+    }
+
+    bool hasExpiredService(qint64 cutoff) const
+    {
+        const int services = header()->serviceCount;
+        for (int i = 0; i < services; ++i) {
+            if (lastSeen(i) < cutoff)
+                return true;
+        }
+        return false;
+    }
+
+    int find(const QByteArray &path) const
+    {
+        const int services = header()->serviceCount;
+        __sync_synchronize();
+        for (int i = 0; i < services; ++i) {
+            if (path == serviceSlots()[i].path)
+                return i;
+        }
+        return -1;
+    }
+
+    bool map()
+    {
+        struct stat info;
+        if (::fstat(fd, &info) < 0 || size_t(info.st_size) < RecordsOffset)
+            return false;
+
+        void *address = ::mmap(NULL, info.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+                               MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED)
+            return false;
+
+        data = static_cast<uchar *>(address);
+        size = info.st_size;
+
+        const Header *h = header();
+        if (memcmp(h->magic, Magic, sizeof(Magic)) == 0
+                && h->version == Version
+                && h->recordSize == sizeof(Record)
+                && size >= fileSize(h->capacity)
+                && h->count <= h->capacity
+                && h->serviceCount <= MaxServices) {
+            return true;
+        }
+
+        ::munmap(data, size);
+        data = NULL;
+        size = 0;
+        return false;
+    }
+
+    // A descriptor of the file holding the append lock, or -1 if taken
+    static int lock(const QByteArray &path)
+    {
+        for (;;) {
+            const int fd = ::open(path.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return -1;
+
+            struct stat locked;
+            if (::flock(fd, LOCK_EX | LOCK_NB) < 0 || ::fstat(fd, &locked) < 0) {
+                ::close(fd);
+                return -1;
+            }
+
+            // A compaction may have replaced the file since it was opened
+            struct stat current;
+            if (::stat(path.constData(), &current) == 0
+                    && current.st_dev == locked.st_dev && current.st_ino == locked.st_ino) {
+                return fd;
+            }
+            ::close(fd);
+        }
+    }
+
+    // Maps the file for appending through lockedFd, or read only without it
+    static Mapping *open(const QByteArray &path, int lockedFd)
+    {
+        Mapping *mapping = new Mapping;
+        mapping->fd = lockedFd;
+        mapping->writable = lockedFd >= 0;
+        if (!mapping->writable)
+            mapping->fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+
+        if (mapping->fd < 0) {
+            if (errno != ENOENT)
+                qWarning() << "UsageStore: cannot open" << path << strerror(errno);
+            delete mapping;
+            return NULL;
+        }
+
+        if (mapping->map())
+            return mapping;
+
+        if (!mapping->writable) {
+            qWarning() << "UsageStore: not a usage store" << path;
+            delete mapping;
+            return NULL;
+        }
+
+        // Anything but a new file is kept aside rather than written over
+        struct stat info;
+        if (::fstat(mapping->fd, &info) < 0 || size_t(info.st_size) >= sizeof(Header)) {
+            const QByteArray badPath = path + ".bad";
+            qWarning() << "UsageStore: not a usage store, moving" << path << "to" << badPath;
+            ::close(mapping->fd);
+            mapping->fd = -1;
+            if (::rename(path.constData(), badPath.constData()) < 0
+                    || (mapping->fd = lock(path)) < 0) {
+                qWarning() << "UsageStore: cannot replace" << path << strerror(errno);
+                delete mapping;
+                return NULL;
+            }
+        }
+
+        if (!initialize(mapping->fd, InitialCapacity) || !mapping->map()) {
+            qWarning() << "UsageStore: cannot initialize" << path << strerror(errno);
+            delete mapping;
+            return NULL;
+        }
+        return mapping;
+    }
+
+    static Mapping *create(const QByteArray &path, quint32 capacity)
+    {
+        Mapping *mapping = new Mapping;
+        mapping->writable = true;
+        mapping->fd = ::open(path.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (mapping->fd < 0 || ::flock(mapping->fd, LOCK_EX | LOCK_NB) < 0
+                || !initialize(mapping->fd, capacity) || !mapping->map()) {
+            qWarning() << "UsageStore: cannot create" << path << strerror(errno);
+            delete mapping;
+            return NULL;
+        }
+        return mapping;
+    }
+
+    int fd;
+    uchar *data;
+    size_t size;
+    bool writable;
+
+private:
+    Q_DISABLE_COPY(Mapping)
+};
+
+UsageStore::UsageStore(QObject *parent)
+    : QObject(parent),
+      m_mapping(NULL),
+      m_count(0)
+{
+}
+
+UsageStore::~UsageStore()
+{
+    close();
+}
+
+QString UsageStore::fileName() const
+{
+    return m_fileName;
+}
+
+void UsageStore::setFileName(const QString &fileName)
+{
+    if (m_fileName == fileName)
+        return;
+
+    m_fileName = fileName;
+    reopen();
+    Q_EMIT fileNameChanged(m_fileName);
+}
+
+Counter *UsageStore::counter() const
+{
+    return m_counter;
+}
+
+void UsageStore::setCounter(Counter *counter)
+{
+    if (m_counter == counter)
+        return;
+
+    if (m_counter) {
+        disconnect(m_counter, SIGNAL(counterChanged(QString,QVariantMap,bool)),
+                   this, SLOT(append(QString,QVariantMap,bool)));
+    }
+
+    m_counter = counter;
+
+    if (m_counter) {
+        connect(m_counter, SIGNAL(counterChanged(QString,QVariantMap,bool)),
+                this, SLOT(append(QString,QVariantMap,bool)));
+        takeOver();
+    } else if (isWritable()) {
+        // Leave appending to a store that has a counter to follow
+        reopen();
+    }
+
+    Q_EMIT counterChanged(m_counter);
+}
+
+bool UsageStore::isOpen() const
+{
+    return m_mapping != NULL;
+}
+
+bool UsageStore::isWritable() const
+{
+    return m_mapping && m_mapping->writable;
+}
+
+int UsageStore::count() const
+{
+    return m_count;
+}
+
+UsageStore::Sample UsageStore::sample(int index) const
+{
+    Sample sample;
+    if (index < 0 || index >= m_count)
+        return sample;
+
+    const Record &record = m_mapping->records()[index];
+    sample.servicePath = StringPool::intern(
+            QString::fromUtf8(m_mapping->serviceSlots()[record.service].path));
+    sample.timestamp = record.timestamp;
+    sample.rxBytes = record.rx;
+    sample.txBytes = record.tx;
+    sample.seconds = record.seconds;
+    sample.roaming = record.roaming;
+    return sample;
+}
+
+QStringList UsageStore::services() const
+{
+    QStringList services;
+    if (!m_mapping)
+        return services;
+
+    const int count = m_mapping->header()->serviceCount;
+    __sync_synchronize();
+    for (int i = 0; i < count; ++i)
+        services.append(QString::fromUtf8(m_mapping->serviceSlots()[i].path));
+    return services;
+}
+
+QVariantMap UsageStore::latest(const QString &servicePath, bool roaming) const
+{
+    QVariantMap counters;
+    if (!m_mapping)
+        return counters;
+
+    const int service = m_mapping->find(servicePath.toUtf8());
+    if (service < 0)
+        return counters;
+
+    const qint32 last = m_mapping->serviceSlots()[service].last[roaming];
+    if (last < 0 || last >= m_count)
+        return counters;
+
+    const Record &record = m_mapping->records()[last];
+    counters.insert(RxBytesKey, record.rx);
+    counters.insert(TxBytesKey, record.tx);
+    counters.insert(TimeKey, record.seconds);
+    return counters;
+}
+
+void UsageStore::append(const QString &servicePath, const QVariantMap &counters, bool roaming)
+{
+    append(servicePath, counters, roaming, QDateTime::currentMSecsSinceEpoch());
+}
+
+void UsageStore::append(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                        qint64 timestamp)
+{
+    takeOver();
+    if (!isWritable())
+        return;
+
+    const QByteArray path = servicePath.toUtf8();
+    if (path.size() >= PathLength) {
+        qWarning() << "UsageStore: service path too long" << servicePath;
+        return;
+    }
+
+    // A new service only gets a slot freed by one that expired
+    const bool noSlot = m_mapping->find(path) < 0
+        && m_mapping->header()->serviceCount == MaxServices;
+    if (noSlot && !m_mapping->hasExpiredService(QDateTime::currentMSecsSinceEpoch() - Retention)) {
+        qWarning() << "UsageStore: too many services";
+        return;
+    }
+
+    if (noSlot || quint32(m_count) >= m_mapping->header()->capacity) {
+        if (!compact())
+            return;
+    }
+
+    const int service = serviceIndex(path);
+    if (service < 0) {
+        qWarning() << "UsageStore: too many services";
+        return;
+    }
+
+    Slot &slot = m_mapping->serviceSlots()[service];
+    Record *records = m_mapping->records();
+    const qint32 previous = slot.last[roaming];
+
+    // Values connman did not report have not changed
+    Record &record = records[m_count];
+    record.timestamp = timestamp;
+    record.rx = valueOf(counters, RxBytesKey, previous < 0 ? 0 : records[previous].rx);
+    record.tx = valueOf(counters, TxBytesKey, previous < 0 ? 0 : records[previous].tx);
+    record.seconds = valueOf(counters, TimeKey, previous < 0 ? 0 : records[previous].seconds);
+    record.service = service;
+    record.roaming = roaming;
+    slot.last[roaming] = m_count;
+
+    __sync_synchronize();
+    m_mapping->header()->count = ++m_count;
+    Q_EMIT countChanged(m_count);
+}
+
+/*
+ * Picks up samples appended by another process since the last call, and
+ * reopens the file if it has been replaced by a compaction or if appending
+ * can be taken over.
+ */
+bool UsageStore::refresh()
+{
+    if (takeOver())
+        return true;
+
+    if (!m_mapping || (m_mapping->header()->flags & ReplacedFlag)) {
+        reopen();
+        return m_mapping != NULL;
+    }
+
+    const int count = m_mapping->count();
+    if (count == m_count)
+        return false;
+
+    m_count = count;
+    Q_EMIT countChanged(m_count);
+    return true;
+}
+
+/*
+ * Writes the samples worth keeping to a new file, which then replaces the
+ * current one. Readers notice the old file being marked as replaced.
+ * Services without samples within the retention are dropped altogether.
+ */
+bool UsageStore::compact()
+{
+    if (!isWritable())
+        return false;
+
+    const Record *records = m_mapping->records();
+    const Slot *oldSlots = m_mapping->serviceSlots();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 cutoff = now - Retention;
+
+    QVector<bool> expired(MaxServices, false);
+    for (quint32 i = 0; i < m_mapping->header()->serviceCount; ++i)
+        expired[i] = m_mapping->lastSeen(i) < cutoff;
+
+    // Newest first, comparing each sample with the next one of its series
+    QVector<bool> keep(m_count, false);
+    QVector<qint32> next(MaxServices * 2, -1);
+    for (int i = m_count - 1; i >= 0; --i) {
+        const Record &record = records[i];
+        const int series = record.service * 2 + record.roaming;
+        const qint32 following = next.at(series);
+
+        if (expired.at(record.service)) {
+            keep[i] = false;
+        } else if (following < 0) {
+            keep[i] = true;
+        } else if (record.timestamp < cutoff) {
+            // Only the baseline for what follows the cutoff
+            keep[i] = records[following].timestamp >= cutoff;
+        } else {
+            keep[i] = bucketOf(record.timestamp, now) != bucketOf(records[following].timestamp, now)
+                   || isReset(record, records[following]);
+        }
+        next[series] = i;
+    }
+
+    QVector<int> serviceMap(MaxServices, -1);
+    int services = 0;
+    int kept = 0;
+    for (int i = 0; i < m_count; ++i) {
+        if (!keep.at(i))
+            continue;
+        ++kept;
+        if (serviceMap.at(records[i].service) < 0)
+            serviceMap[records[i].service] = services++;
+    }
+
+    quint32 capacity = InitialCapacity;
+    while (capacity < quint32(kept) * 2)
+        capacity *= 2;
+
+    const QByteArray path = QFile::encodeName(m_fileName);
+    const QByteArray compactedPath = path + ".new";
+    Mapping *compacted = Mapping::create(compactedPath, capacity);
+    if (!compacted)
+        return false;
+
+    Slot *compactedSlots = compacted->serviceSlots();
+    for (int i = 0; i < MaxServices; ++i) {
+        const int service = serviceMap.at(i);
+        if (service < 0)
+            continue;
+        memcpy(compactedSlots[service].path, oldSlots[i].path, PathLength);
+        compactedSlots[service].last[0] = compactedSlots[service].last[1] = -1;
+    }
+
+    Record *compactedRecords = compacted->records();
+    int count = 0;
+    for (int i = 0; i < m_count; ++i) {
+        if (!keep.at(i))
+            continue;
+        Record &record = compactedRecords[count];
+        record = records[i];
+        record.service = serviceMap.at(record.service);
+        compactedSlots[record.service].last[record.roaming] = count;
+        ++count;
+    }
+    compacted->header()->serviceCount = services;
+    compacted->header()->count = count;
+
+    // Only a complete file may take the place of the old one
+    if (::fsync(compacted->fd) < 0) {
+        qWarning() << "UsageStore: cannot sync" << compactedPath << strerror(errno);
+        ::unlink(compactedPath.constData());
+        delete compacted;
+        return false;
+    }
+
+    if (::rename(compactedPath.constData(), path.constData()) < 0) {
+        qWarning() << "UsageStore: cannot replace" << path << strerror(errno);
+        ::unlink(compactedPath.constData());
+        delete compacted;
+        return false;
+    }
+
+    m_mapping->header()->flags |= ReplacedFlag;
+    delete m_mapping;
+    m_mapping = compacted;
+
+    if (m_count != count) {
+        m_count = count;
+        Q_EMIT countChanged(m_count);
+    }
+    return true;
+}
+
+bool UsageStore::open(int lockedFd)
+{
+    if (m_fileName.isEmpty())
+        return false;
+
+    // Only a store following a counter takes the lock and appends
+    const QByteArray path = QFile::encodeName(m_fileName);
+    if (lockedFd < 0 && m_counter)
+        lockedFd = Mapping::lock(path);
+
+    m_mapping = Mapping::open(path, lockedFd);
+    if (!m_mapping)
+        return false;
+
+    m_count = m_mapping->count();
+    return true;
+}
+
+void UsageStore::close()
+{
+    delete m_mapping;
+    m_mapping = NULL;
+    m_count = 0;
+}
+
+void UsageStore::reopen(int lockedFd)
+{
+    const bool wasWritable = isWritable();
+    const int previousCount = m_count;
+
+    close();
+    open(lockedFd);
+
+    if (isWritable() != wasWritable)
+        Q_EMIT writableChanged(isWritable());
+    if (m_count != previousCount)
+        Q_EMIT countChanged(m_count);
+}
+
+// Appending is taken over once the process that held the lock is gone
+bool UsageStore::takeOver()
+{
+    if (!m_counter || isWritable() || m_fileName.isEmpty())
+        return false;
+
+    const int fd = Mapping::lock(QFile::encodeName(m_fileName));
+    if (fd < 0)
+        return false;
+
+    reopen(fd);
+    return true;
+}
+
+// The slot of a service, taking a free one for a new service
+int UsageStore::serviceIndex(const QByteArray &path)
+{
+    const int service = m_mapping->find(path);
+    if (service >= 0)
+        return service;
+
+    Header *header = m_mapping->header();
+    if (header->serviceCount == MaxServices)
+        return -1;
+
+    Slot &slot = m_mapping->serviceSlots()[header->serviceCount];
+    memset(slot.path, 0, PathLength);
+    memcpy(slot.path, path.constData(), path.size());
+    slot.last[0] = slot.last[1] = -1;
+
+    __sync_synchronize();
+    return header->serviceCount++;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef USAGESTORE_H
+#define USAGESTORE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QVariantMap>
+
+class Counter;
+
+/*
+ * Append-only log of the Usage values reported to a Counter, kept in a
+ * memory mapped file of fixed size records. Opening it maps the file and
+ * nothing is parsed, so the history is available right away after a
+ * restart. One store with a counter appends, holding a lock on the file,
+ * any number of others may read it at the same time. When the one holding
+ * the lock goes away, the next store with a counter to refresh or append
+ * takes over.
+ *
+ * When the file fills up it is compacted into a new one: old samples are
+ * thinned out to the last one per minute, hour or day depending on their
+ * age, and samples beyond the retention only keep a baseline. Services
+ * with nothing newer than the retention give up their slot.
+ */
+class UsageStore : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
+    Q_PROPERTY(Counter *counter READ counter WRITE setCounter NOTIFY counterChanged)
+    Q_PROPERTY(bool writable READ isWritable NOTIFY writableChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(QStringList services READ services NOTIFY countChanged)
+
+    Q_DISABLE_COPY(UsageStore)
+
+public:
+    struct Sample
+    {
+        Sample() : timestamp(0), rxBytes(0), txBytes(0), seconds(0), roaming(false) {}
+
+        QString servicePath;
+        qint64 timestamp; // [ms since the epoch]
+        quint64 rxBytes;
+        quint64 txBytes;
+        quint32 seconds;
+        bool roaming;
+    };
+
+    explicit UsageStore(QObject *parent = 0);
+    virtual ~UsageStore();
+
+    QString fileName() const;
+    void setFileName(const QString &fileName);
+
+    Counter *counter() const;
+    void setCounter(Counter *counter);
+
+    bool isOpen() const;
+    bool isWritable() const;
+
+    /* Samples are in the order they were added */
+    int count() const;
+    Sample sample(int index) const;
+    QStringList services() const;
+
+    /* The newest values of a service as RX.Bytes, TX.Bytes and Time */
+    Q_INVOKABLE QVariantMap latest(const QString &servicePath, bool roaming) const;
+
+    void append(const QString &servicePath, const QVariantMap &counters, bool roaming,
+                qint64 timestamp);
+
+public Q_SLOTS:
+    void append(const QString &servicePath, const QVariantMap &counters, bool roaming);
+    bool refresh();
+    bool compact();
+
+Q_SIGNALS:
+    void fileNameChanged(const QString &fileName);
+    void counterChanged(Counter *counter);
+    void writableChanged(bool writable);
+    void countChanged(int count);
+
+private:
+    struct Mapping;
+
+    bool open(int lockedFd = -1);
+    void close();
+    void reopen(int lockedFd = -1);
+    bool takeOver();
+    int serviceIndex(const QByteArray &path);
+
+    QString m_fileName;
+    QPointer<Counter> m_counter;
+    Mapping *m_mapping;
+    int m_count;
+};
+
+#endif // USAGESTORE_H
@@ -17,6 +17,8 @@
 #include "useragent.h"
 #include "networksession.h"
 #include "counter.h"
+#include "counteraggregator.h"
+#include "usagestore.h"
 
 void Components::registerTypes(const char *uri)
 {
@@ -33,6 +35,8 @@ void Components::registerTypes(const char *uri)
     qmlRegisterType<NetworkManagerFactory>(uri,0,2,"NetworkManagerFactory");
     qmlRegisterType<NetworkTechnology>(uri,0,2,"NetworkTechnology");
     qmlRegisterType<Counter>(uri,0,2,"NetworkCounter");
+    qmlRegisterType<CounterAggregator>(uri,0,2,"CounterAggregator");
+    qmlRegisterType<UsageStore>(uri,0,2,"UsageStore");
 }
 
 void Components::initializeEngine(QDeclarativeEngine *engine, const char *uri)
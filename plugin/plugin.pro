@@ -2,8 +2,8 @@ TARGET=ConnmanQtDeclarative
 TEMPLATE = lib
 QT += dbus
 CONFIG += plugin
-SOURCES = components.cpp networkingmodel.cpp technologymodel.cpp savedservicemodel.cpp
-HEADERS = components.h networkingmodel.h technologymodel.h savedservicemodel.h
+SOURCES = components.cpp networkingmodel.cpp technologymodel.cpp savedservicemodel.cpp servicelistmodel.cpp
+HEADERS = components.h networkingmodel.h technologymodel.h savedservicemodel.h servicelistmodel.h
 INCLUDEPATH += ../libconnman-qt
 LIBS += -L../libconnman-qt
 QT -= gui
@@ -25,7 +25,7 @@ bool compareServiceStrength(NetworkService *a, NetworkService *b)
 }
 
 SavedServiceModel::SavedServiceModel(QAbstractListModel* parent)
-:   QAbstractListModel(parent), m_sort(false)
+:   ServiceListModel(parent), m_sort(false)
 {
     m_manager = NetworkManagerFactory::createInstance();
 
@@ -113,51 +113,13 @@ NetworkService *SavedServiceModel::get(int index) const
     return m_services.value(index);
 }
 
-int SavedServiceModel::indexOf(const QString &dbusObjectPath) const
-{
-    int idx(-1);
-
-    Q_FOREACH (NetworkService *service, m_services) {
-        idx++;
-        if (service->path() == dbusObjectPath) return idx;
-    }
-
-    return -1;
-}
-
 void SavedServiceModel::updateServiceList()
 {
     QVector<NetworkService *> new_services = m_manager->getSavedServices(m_techname);
     if (m_sort)
         std::stable_sort(new_services.begin(), new_services.end(), compareServiceStrength);
 
-    int num_new = new_services.count();
-
-    for (int i = 0; i < num_new; i++) {
-        int j = m_services.indexOf(new_services.value(i));
-        if (j == -1) {
-            // wifi service not found -> remove from list
-            beginInsertRows(QModelIndex(), i, i);
-            m_services.insert(i, new_services.value(i));
-            endInsertRows();
-        } else if (i != j) {
-            // wifi service changed its position -> move it
-            NetworkService* service = m_services.value(j);
-            beginMoveRows(QModelIndex(), j, j, QModelIndex(), i);
-            m_services.remove(j);
-            m_services.insert(i, service);
-            endMoveRows();
-        } else {
-            QModelIndex changedIndex(this->index(j, 0, QModelIndex()));
-            Q_EMIT dataChanged(changedIndex, changedIndex);
-        }
-    }
-
-    int num_old = m_services.count();
-    if (num_old > num_new) {
-        beginRemoveRows(QModelIndex(), num_new, num_old - 1);
-        m_services.remove(num_new, num_old - num_new);
-        endRemoveRows();
-    }
+    // Rows may need refreshing even if none moved, as saved services are not
+    // otherwise watched
+    updateServices(new_services, true);
 }
-
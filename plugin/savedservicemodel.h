@@ -13,14 +13,14 @@
 #ifndef SAVEDSERVICEMODEL_H
 #define SAVEDSERVICEMODEL_H
 
-#include <QAbstractListModel>
+#include "servicelistmodel.h"
 #include <networkmanager.h>
 #include <networkservice.h>
 
 /*
  * SavedServiceModel is a list model containing saved wifi services.
  */
-class SavedServiceModel : public QAbstractListModel
+class SavedServiceModel : public ServiceListModel
 {
     Q_OBJECT
     Q_DISABLE_COPY(SavedServiceModel)
@@ -45,8 +45,6 @@ public:
     bool sort() const;
     void setSort(bool sortList);
 
-    Q_INVOKABLE int indexOf(const QString &dbusObjectPath) const;
-
     Q_INVOKABLE NetworkService *get(int index) const;
 
 Q_SIGNALS:
@@ -56,7 +54,6 @@ Q_SIGNALS:
 private:
     QString m_techname;
     NetworkManager* m_manager;
-    QVector<NetworkService *> m_services;
     bool m_sort;
 
     QHash<int, QByteArray> roleNames() const;
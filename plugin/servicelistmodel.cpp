@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include "servicelistmodel.h"
+#include <listreconciler_p.h>
+
+ServiceListModel::ServiceListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+ServiceListModel::~ServiceListModel()
+{
+}
+
+int ServiceListModel::indexOf(const QString &dbusObjectPath) const
+{
+    return m_rowsByPath.value(dbusObjectPath, -1);
+}
+
+/*
+ * Keeps the rows in line and m_rowsByPath with them, announcing each step
+ * around the change as QAbstractItemModel wants.
+ */
+class ServiceRowsReconciler : public ListReconciler<NetworkService *>
+{
+public:
+    explicit ServiceRowsReconciler(ServiceListModel *model)
+        : ListReconciler<NetworkService *>(model->m_services),
+          m_model(model)
+    {
+    }
+
+protected:
+    void aboutToRemove(int first, int last)
+    {
+        for (int i = first; i <= last; ++i)
+            m_model->m_rowsByPath.remove(m_items.at(i)->path());
+        m_model->beginRemoveRows(QModelIndex(), first, last);
+    }
+
+    void removed(int first, int)
+    {
+        m_model->endRemoveRows();
+        m_model->updateRowsByPath(first, m_items.count() - 1);
+    }
+
+    void aboutToInsert(int first, int last)
+    {
+        m_model->beginInsertRows(QModelIndex(), first, last);
+    }
+
+    void inserted(int first, int)
+    {
+        m_model->endInsertRows();
+        m_model->updateRowsByPath(first, m_items.count() - 1);
+    }
+
+    void aboutToMove(int from, int to)
+    {
+        m_model->beginMoveRows(QModelIndex(), from, from, QModelIndex(), to);
+    }
+
+    void moved(int from, int to)
+    {
+        m_model->endMoveRows();
+        m_model->updateRowsByPath(qMin(from, to), qMax(from, to));
+    }
+
+private:
+    ServiceListModel *m_model;
+};
+
+// Reconciles the rows with services, see ListReconciler
+void ServiceListModel::updateServices(const QVector<NetworkService *> &services, bool refreshRows)
+{
+    ServiceRowsReconciler reconciler(this);
+    reconciler.update(services);
+
+    if (refreshRows && !m_services.isEmpty())
+        Q_EMIT dataChanged(index(0, 0), index(m_services.count() - 1, 0));
+}
+
+void ServiceListModel::removeService(int row)
+{
+    // The service may be on its way out, so its path is not asked for
+    QHash<QString, int>::iterator it = m_rowsByPath.begin();
+    for ( ; it != m_rowsByPath.end(); ++it) {
+        if (*it == row) {
+            m_rowsByPath.erase(it);
+            break;
+        }
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_services.remove(row);
+    endRemoveRows();
+
+    updateRowsByPath(row, m_services.count() - 1);
+}
+
+// The rows from first to last have moved, the paths of the others are in place
+void ServiceListModel::updateRowsByPath(int first, int last)
+{
+    for (int i = first; i <= last; ++i)
+        m_rowsByPath.insert(m_services.at(i)->path(), i);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2013, Jolla.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef SERVICELISTMODEL_H
+#define SERVICELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+#include <networkservice.h>
+
+/*
+ * Common base of the service list models. Keeps the rows and brings them
+ * in line with a new list using the least row notifications, together with
+ * the index of the rows by path.
+ */
+class ServiceListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ServiceListModel)
+
+public:
+    explicit ServiceListModel(QObject *parent = 0);
+    virtual ~ServiceListModel();
+
+    Q_INVOKABLE int indexOf(const QString &dbusObjectPath) const;
+
+protected:
+    void updateServices(const QVector<NetworkService *> &services, bool refreshRows = false);
+    void removeService(int row);
+
+    QVector<NetworkService *> m_services;
+
+private:
+    friend class ServiceRowsReconciler;
+
+    void updateRowsByPath(int first, int last);
+
+    QHash<QString, int> m_rowsByPath;
+};
+
+#endif // SERVICELISTMODEL_H
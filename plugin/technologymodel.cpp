@@ -12,7 +12,7 @@
 #include "technologymodel.h"
 
 TechnologyModel::TechnologyModel(QAbstractListModel* parent)
-  : QAbstractListModel(parent),
+  : ServiceListModel(parent),
     m_manager(NULL),
     m_tech(NULL),
     m_scanning(false),
@@ -231,18 +231,6 @@ NetworkService *TechnologyModel::get(int index) const
     return m_services.value(index);
 }
 
-int TechnologyModel::indexOf(const QString &dbusObjectPath) const
-{
-    int idx(-1);
-
-    Q_FOREACH (NetworkService *service, m_services) {
-        idx++;
-        if (service->path() == dbusObjectPath) return idx;
-    }
-
-    return -1;
-}
-
 void TechnologyModel::updateServiceList()
 {
     if (m_changesInhibited) {
@@ -270,31 +258,7 @@ void TechnologyModel::updateServiceList()
                 this, SLOT(networkServiceDestroyed(QObject*)));
     }
 
-    for (int i = 0; i < num_new; i++) {
-        int j = m_services.indexOf(new_services.value(i));
-        if (j == -1) {
-            // wifi service not found -> remove from list
-            beginInsertRows(QModelIndex(), i, i);
-            m_services.insert(i, new_services.value(i));
-            endInsertRows();
-        } else if (i != j) {
-            // wifi service changed its position -> move it
-            NetworkService* service = m_services.value(j);
-            beginMoveRows(QModelIndex(), j, j, QModelIndex(), i);
-            m_services.remove(j);
-            m_services.insert(i, service);
-            endMoveRows();
-        }
-    }
-    // After loop:
-    // m_services contains [new_services, old_services \ new_services]
-
-    int num_union = m_services.count();
-    if (num_union > num_new) {
-        beginRemoveRows(QModelIndex(), num_new, num_union - 1);
-        m_services.remove(num_new, num_union - num_new);
-        endRemoveRows();
-    }
+    updateServices(new_services);
 
     if (num_new != num_old)
         Q_EMIT countChanged();
@@ -342,8 +306,6 @@ void TechnologyModel::networkServiceDestroyed(QObject *service)
     int ind = m_services.indexOf(static_cast<NetworkService*>(service));
     if (ind>=0) {
         qWarning() << "out-of-band removal of network service" << service;
-        beginRemoveRows(QModelIndex(), ind, ind);
-        m_services.remove(ind);
-        endRemoveRows();
+        removeService(ind);
     }
 }
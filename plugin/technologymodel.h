@@ -13,7 +13,7 @@
 #ifndef TECHNOLOGYMODEL_H
 #define TECHNOLOGYMODEL_H
 
-#include <QAbstractListModel>
+#include "servicelistmodel.h"
 #include <networkmanager.h>
 #include <networktechnology.h>
 #include <networkservice.h>
@@ -21,7 +21,7 @@
 /*
  * TechnologyModel is a list model specific to a certain technology (wifi by default).
  */
-class TechnologyModel : public QAbstractListModel
+class TechnologyModel : public ServiceListModel
 {
     Q_OBJECT
     Q_DISABLE_COPY(TechnologyModel)
@@ -57,8 +57,6 @@ public:
     void setName(const QString &name);
     void setChangesInhibited(bool b);
 
-    Q_INVOKABLE int indexOf(const QString &dbusObjectPath) const;
-
     Q_INVOKABLE NetworkService *get(int index) const;
 
 public Q_SLOTS:
@@ -81,7 +79,6 @@ private:
     QString m_techname;
     NetworkManager* m_manager;
     NetworkTechnology* m_tech;
-    QVector<NetworkService *> m_services;
     bool m_scanning;
     bool m_changesInhibited;
     bool m_uneffectedChanges;
@@ -12,6 +12,21 @@
 
 namespace Tests {
 
+// Shared by the usage accounting tests
+namespace UsageFixtures {
+
+const QString Wifi("/net/connman/service/wifi_0011223344_436f6e6e_managed_psk");
+const QString Cellular("/net/connman/service/cellular_244050123456789_context1");
+
+const qint64 Second = 1000; // [ms]
+const qint64 Minute = 60 * Second;
+const qint64 Hour = 60 * Minute;
+const qint64 Day = 24 * Hour;
+// Start of a day in UTC
+const qint64 Start = Q_INT64_C(1377993600000);
+
+}
+
 class TestBase : public QObject
 {
 public:
@@ -54,6 +69,8 @@ protected:
     static QVariantMap defaultTechnologyProperties();
     static QVariantMap alternateDefaultTechnologyProperties();
     static QVariantMap defaultClockProperties();
+    static QVariantMap counters(const QVariant &rx, const QVariant &tx,
+        const QVariant &time = QVariant());
 };
 
 class TestBase::MainObjectMock : public QObject
@@ -569,6 +586,20 @@ inline QVariantMap TestBase::defaultClockProperties()
     return properties;
 }
 
+// Counter values as connman reports them, the invalid ones left out
+inline QVariantMap TestBase::counters(const QVariant &rx, const QVariant &tx,
+        const QVariant &time)
+{
+    QVariantMap counters;
+    if (rx.isValid())
+        counters.insert("RX.Bytes", rx.toULongLong());
+    if (tx.isValid())
+        counters.insert("TX.Bytes", tx.toULongLong());
+    if (time.isValid())
+        counters.insert("Time", time.toUInt());
+    return counters;
+}
+
 /*
  * \class Tests::TestBase::MainObjectMock
  */
@@ -4,10 +4,16 @@ TEMPLATE = subdirs
 SUBDIRS = \
     ut_agent.pro \
     ut_clock.pro \
+    ut_counter.pro \
+    ut_counteraggregator.pro \
+    ut_dbustypes.pro \
     ut_manager.pro \
+    ut_models.pro \
+    ut_routemonitor.pro \
     ut_service.pro \
     ut_session.pro \
     ut_technology.pro \
+    ut_usagestore.pro \
 
 runtest_sh.path = $${INSTALL_TESTDIR}
 runtest_sh.files = runtest.sh
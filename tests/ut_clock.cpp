@@ -23,6 +23,7 @@ private slots:
 
     void testProperties_data();
     void testProperties();
+    void testPropertyIds();
     void testWriteProperties_data();
     void testWriteProperties();
     void testSetDate();
@@ -100,6 +101,17 @@ void UtClock::testProperties()
     testProperty(*m_clock, QTest::currentDataTag(), expected);
 }
 
+void UtClock::testPropertyIds()
+{
+    QCOMPARE(ClockModel::propertyId("Timezone"), int(ClockModel::TimezoneProperty));
+    QCOMPARE(ClockModel::propertyId("TimezoneUpdates"), int(ClockModel::TimezoneUpdatesProperty));
+    QCOMPARE(ClockModel::propertyId("TimeUpdates"), int(ClockModel::TimeUpdatesProperty));
+    QCOMPARE(ClockModel::propertyId("Timeservers"), int(ClockModel::TimeserversProperty));
+
+    QCOMPARE(ClockModel::propertyId("Time"), -1);
+    QCOMPARE(ClockModel::propertyId("timezone"), -1);
+}
+
 void UtClock::testWriteProperties_data()
 {
     QTest::addColumn<QVariant>("newValue");
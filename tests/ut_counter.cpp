@@ -0,0 +1,446 @@
+#include "../libconnman-qt/counter.h"
+#include "../libconnman-qt/networkmanager.h"
+#include "testbase.h"
+
+namespace Tests {
+
+class UtCounter : public TestBase
+{
+    Q_OBJECT
+
+public:
+    class ManagerMock;
+
+private slots:
+    void initTestCase();
+
+    void testSharedRegistration();
+    void testDownSampling();
+    void testHeldBackFlushed();
+    void testHeldBackRates();
+    void testRates();
+    void testBatchedReconfiguration();
+    void testTotalsCarriedOver();
+
+private:
+    static bool sendUsage(const QVariantMap &home);
+};
+
+class UtCounter::ManagerMock : public MainObjectMock
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.connman.Manager")
+
+public:
+    ManagerMock();
+
+public:
+    Q_SCRIPTABLE QVariantMap GetProperties() const;
+    Q_SCRIPTABLE ConnmanObjectList GetTechnologies() const;
+    Q_SCRIPTABLE ConnmanObjectList GetServices() const;
+    Q_SCRIPTABLE void RegisterCounter(const QDBusObjectPath &path, quint32 accuracy, quint32 period,
+            const QDBusMessage &message);
+    Q_SCRIPTABLE void UnregisterCounter(const QDBusObjectPath &path, const QDBusMessage &message);
+
+    // mock API
+    Q_SCRIPTABLE int mock_counterCount() const;
+    Q_SCRIPTABLE int mock_registrationCount() const;
+    Q_SCRIPTABLE quint32 mock_counterAccuracy() const;
+    Q_SCRIPTABLE quint32 mock_counterPeriod() const;
+    Q_SCRIPTABLE void mock_sendUsage(const QString &servicePath, const QVariantMap &home,
+            const QDBusMessage &message);
+
+private:
+    struct Registration
+    {
+        QString service;
+        quint32 accuracy;
+        quint32 period;
+    };
+
+    QMap<QString, Registration> m_counters;
+    int m_registrations;
+};
+
+} // namespace Tests
+
+using namespace Tests;
+using namespace Tests::UsageFixtures;
+
+/*
+ * \class Tests::UtCounter
+ */
+
+void UtCounter::initTestCase()
+{
+    QVERIFY(waitForService("net.connman", "/", "net.connman.Manager"));
+    QVERIFY(NetworkManagerFactory::createInstance()->isAvailable());
+}
+
+void UtCounter::testSharedRegistration()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    Counter coarse;
+    coarse.setAccuracy(1024);
+    coarse.setInterval(10);
+    coarse.setRunning(true);
+    QVERIFY(coarse.running());
+
+    Counter fine;
+    fine.setAccuracy(100);
+    fine.setInterval(60);
+    fine.setRunning(true);
+    QVERIFY(fine.running());
+    QCoreApplication::processEvents();
+
+    QDBusReply<int> count = manager.call("mock_counterCount");
+    QVERIFY2(count.isValid(), qPrintable(count.error().message()));
+    QCOMPARE(count.value(), 1);
+
+    QDBusReply<quint32> accuracy = manager.call("mock_counterAccuracy");
+    QCOMPARE(accuracy.value(), 100u);
+    QDBusReply<quint32> period = manager.call("mock_counterPeriod");
+    QCOMPARE(period.value(), 10u);
+
+    fine.setRunning(false);
+    QVERIFY(!fine.running());
+    QCoreApplication::processEvents();
+
+    count = manager.call("mock_counterCount");
+    QCOMPARE(count.value(), 1);
+    accuracy = manager.call("mock_counterAccuracy");
+    QCOMPARE(accuracy.value(), 1024u);
+
+    coarse.setRunning(false);
+
+    count = manager.call("mock_counterCount");
+    QCOMPARE(count.value(), 0);
+}
+
+void UtCounter::testDownSampling()
+{
+    Counter every;
+    every.setInterval(1);
+    every.setRunning(true);
+
+    Counter seldom;
+    seldom.setInterval(60);
+    seldom.setRunning(true);
+    QCoreApplication::processEvents();
+
+    SignalSpy everySpy(&every, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+    SignalSpy seldomSpy(&seldom, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+
+    const QList<QVariantMap> samples = QList<QVariantMap>()
+        << counters(Q_UINT64_C(100), Q_UINT64_C(10))
+        << counters(Q_UINT64_C(200), Q_UINT64_C(20))
+        << counters(Q_UINT64_C(300), QVariant());
+
+    Q_FOREACH (const QVariantMap &sample, samples) {
+        everySpy.clear();
+        QVERIFY(sendUsage(sample));
+        QVERIFY(waitForSignal(&everySpy));
+        QCOMPARE(everySpy.at(0).at(0).toString(), Wifi);
+        QCOMPARE(everySpy.at(0).at(1).toMap(), sample);
+    }
+
+    QCOMPARE(seldomSpy.count(), 1);
+    QCOMPARE(seldomSpy.at(0).at(1).toMap(), samples.first());
+    QCOMPARE(seldom.bytesReceived(), Q_UINT64_C(100));
+
+    // Values held back are merged into the next ones handed over
+    seldomSpy.clear();
+    seldom.setInterval(1);
+    QVERIFY(sendUsage(counters(QVariant(), Q_UINT64_C(40))));
+    QVERIFY(waitForSignal(&seldomSpy));
+    QCOMPARE(seldomSpy.at(0).at(1).toMap(), counters(Q_UINT64_C(300), Q_UINT64_C(40)));
+    QCOMPARE(seldom.bytesReceived(), Q_UINT64_C(300));
+}
+
+void UtCounter::testHeldBackFlushed()
+{
+    Counter every;
+    every.setInterval(1);
+    every.setRunning(true);
+
+    Counter seldom;
+    seldom.setInterval(2);
+    seldom.setRunning(true);
+    QCoreApplication::processEvents();
+
+    SignalSpy everySpy(&every, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+    SignalSpy seldomSpy(&seldom, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+
+    QVERIFY(sendUsage(counters(Q_UINT64_C(100), Q_UINT64_C(10))));
+    QVERIFY(waitForSignal(&everySpy));
+    QCOMPARE(seldomSpy.count(), 1);
+
+    everySpy.clear();
+    seldomSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(200), Q_UINT64_C(20))));
+    QVERIFY(waitForSignal(&everySpy));
+    QCOMPARE(seldomSpy.count(), 0);
+
+    // No more Usage comes, the held back values are handed over anyway
+    QVERIFY(waitForSignal(&seldomSpy));
+    QCOMPARE(seldomSpy.at(0).at(1).toMap(), counters(Q_UINT64_C(200), Q_UINT64_C(20)));
+    QCOMPARE(seldom.bytesReceived(), Q_UINT64_C(200));
+}
+
+void UtCounter::testHeldBackRates()
+{
+    Counter every;
+    every.setInterval(1);
+    every.setRunning(true);
+
+    Counter seldom;
+    seldom.setInterval(2);
+    seldom.setRunning(true);
+    QCoreApplication::processEvents();
+
+    SignalSpy everySpy(&every, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+    SignalSpy seldomSpy(&seldom, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+
+    QVERIFY(sendUsage(counters(Q_UINT64_C(0), Q_UINT64_C(0))));
+    QVERIFY(waitForSignal(&everySpy));
+
+    QTest::qWait(500);
+    everySpy.clear();
+    seldomSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(1000000), Q_UINT64_C(0))));
+    QVERIFY(waitForSignal(&everySpy));
+    QVERIFY(every.rxRate() > 0);
+
+    // Handed over later, but the rate is over the time between the reports
+    QVERIFY(waitForSignal(&seldomSpy));
+    QCOMPARE(seldom.rxRate(), every.rxRate());
+}
+
+void UtCounter::testRates()
+{
+    Counter counter;
+    counter.setInterval(1);
+    counter.setRunning(true);
+    QCoreApplication::processEvents();
+
+    SignalSpy counterSpy(&counter, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+    SignalSpy rxRateSpy(&counter, SIGNAL(rxRateChanged(qreal)));
+    SignalSpy rxPeakRateSpy(&counter, SIGNAL(rxPeakRateChanged(qreal)));
+    SignalSpy txRateSpy(&counter, SIGNAL(txRateChanged(qreal)));
+
+    // The first values only give the baseline
+    QVERIFY(sendUsage(counters(Q_UINT64_C(0), Q_UINT64_C(0))));
+    QVERIFY(waitForSignal(&counterSpy));
+    QCOMPARE(rxRateSpy.count(), 0);
+
+    QTest::qWait(500);
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(1000000), Q_UINT64_C(0))));
+    QVERIFY(waitForSignal(&counterSpy));
+
+    QCOMPARE(rxRateSpy.count(), 1);
+    QCOMPARE(rxPeakRateSpy.count(), 1);
+    QCOMPARE(txRateSpy.count(), 0);
+    const qreal peak = counter.rxRate();
+    QVERIFY(peak > 0);
+    QCOMPARE(counter.rxPeakRate(), peak);
+    QCOMPARE(counter.txRate(), qreal(0));
+
+    // Nothing more received, the rate goes down and the peak stays
+    QTest::qWait(500);
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(1000000), Q_UINT64_C(0))));
+    QVERIFY(waitForSignal(&counterSpy));
+
+    QCOMPARE(rxRateSpy.count(), 2);
+    QVERIFY(counter.rxRate() < peak);
+    QVERIFY(counter.rxRate() > 0);
+    QCOMPARE(counter.rxPeakRate(), peak);
+
+    counter.resetPeakRates();
+    QCOMPARE(counter.rxPeakRate(), counter.rxRate());
+
+    counter.setRunning(false);
+    QCOMPARE(counter.rxRate(), qreal(0));
+}
+
+void UtCounter::testBatchedReconfiguration()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    Counter counter;
+    counter.setRunning(true);
+    QCoreApplication::processEvents();
+
+    QDBusReply<int> registrations = manager.call("mock_registrationCount");
+    QVERIFY2(registrations.isValid(), qPrintable(registrations.error().message()));
+    const int initialRegistrations = registrations.value();
+
+    counter.setAccuracy(10);
+    counter.setInterval(5);
+    QCoreApplication::processEvents();
+
+    registrations = manager.call("mock_registrationCount");
+    QCOMPARE(registrations.value(), initialRegistrations + 1);
+
+    QDBusReply<quint32> accuracy = manager.call("mock_counterAccuracy");
+    QCOMPARE(accuracy.value(), 10u);
+    QDBusReply<quint32> period = manager.call("mock_counterPeriod");
+    QCOMPARE(period.value(), 5u);
+}
+
+void UtCounter::testTotalsCarriedOver()
+{
+    Counter counter;
+    counter.setInterval(1);
+    counter.setRunning(true);
+    QCoreApplication::processEvents();
+
+    SignalSpy counterSpy(&counter, SIGNAL(counterChanged(QString,QVariantMap,bool)));
+
+    QVERIFY(sendUsage(counters(Q_UINT64_C(1000), Q_UINT64_C(100))));
+    QVERIFY(waitForSignal(&counterSpy));
+
+    counter.setAccuracy(512);
+    QCoreApplication::processEvents();
+
+    // connman starts over from zero after the re-registration
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(100), Q_UINT64_C(150))));
+    QVERIFY(waitForSignal(&counterSpy));
+    QCOMPARE(counterSpy.at(0).at(1).toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(1100));
+    QCOMPARE(counterSpy.at(0).at(1).toMap().value("TX.Bytes").toULongLong(), Q_UINT64_C(150));
+
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(300), QVariant())));
+    QVERIFY(waitForSignal(&counterSpy));
+    QCOMPARE(counterSpy.at(0).at(1).toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(1300));
+    QCOMPARE(counter.bytesReceived(), Q_UINT64_C(1300));
+
+    counter.setAccuracy(256);
+    QCoreApplication::processEvents();
+
+    // Keys left out of the first Usage are still checked when they come
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(Q_UINT64_C(50), QVariant())));
+    QVERIFY(waitForSignal(&counterSpy));
+    QCOMPARE(counterSpy.at(0).at(1).toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(1350));
+
+    counterSpy.clear();
+    QVERIFY(sendUsage(counters(QVariant(), Q_UINT64_C(20))));
+    QVERIFY(waitForSignal(&counterSpy));
+    QCOMPARE(counterSpy.at(0).at(1).toMap().value("TX.Bytes").toULongLong(), Q_UINT64_C(170));
+}
+
+bool UtCounter::sendUsage(const QVariantMap &home)
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+    QDBusReply<void> reply = manager.call("mock_sendUsage", Wifi, home);
+    if (!reply.isValid()) {
+        qWarning("%s: %s", Q_FUNC_INFO, qPrintable(reply.error().message()));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * \class Tests::UtCounter::ManagerMock
+ */
+
+UtCounter::ManagerMock::ManagerMock()
+    : MainObjectMock("net.connman", "/"),
+      m_registrations(0)
+{
+}
+
+QVariantMap UtCounter::ManagerMock::GetProperties() const
+{
+    QVariantMap properties;
+    properties["State"] = "online";
+    properties["OfflineMode"] = false;
+    properties["SessionMode"] = false;
+    return properties;
+}
+
+ConnmanObjectList UtCounter::ManagerMock::GetTechnologies() const
+{
+    return ConnmanObjectList();
+}
+
+ConnmanObjectList UtCounter::ManagerMock::GetServices() const
+{
+    return ConnmanObjectList();
+}
+
+void UtCounter::ManagerMock::RegisterCounter(const QDBusObjectPath &path, quint32 accuracy,
+        quint32 period, const QDBusMessage &message)
+{
+    if (m_counters.contains(path.path())) {
+        const QString err = QString("Counter at path '%1' already exists").arg(path.path());
+        qWarning("%s: %s", Q_FUNC_INFO, qPrintable(err));
+        bus().send(message.createErrorReply(QDBusError::Failed, err));
+        return;
+    }
+
+    Registration registration;
+    registration.service = message.service();
+    registration.accuracy = accuracy;
+    registration.period = period;
+    m_counters[path.path()] = registration;
+    ++m_registrations;
+}
+
+void UtCounter::ManagerMock::UnregisterCounter(const QDBusObjectPath &path,
+        const QDBusMessage &message)
+{
+    if (!m_counters.contains(path.path())) {
+        const QString err = QString("Counter at path '%1' does not exist").arg(path.path());
+        qWarning("%s: %s", Q_FUNC_INFO, qPrintable(err));
+        bus().send(message.createErrorReply(QDBusError::Failed, err));
+        return;
+    }
+
+    m_counters.remove(path.path());
+}
+
+int UtCounter::ManagerMock::mock_counterCount() const
+{
+    return m_counters.count();
+}
+
+int UtCounter::ManagerMock::mock_registrationCount() const
+{
+    return m_registrations;
+}
+
+quint32 UtCounter::ManagerMock::mock_counterAccuracy() const
+{
+    return m_counters.isEmpty() ? 0 : m_counters.begin().value().accuracy;
+}
+
+quint32 UtCounter::ManagerMock::mock_counterPeriod() const
+{
+    return m_counters.isEmpty() ? 0 : m_counters.begin().value().period;
+}
+
+// Does not wait for the Usage call, the test is blocked in calling us
+void UtCounter::ManagerMock::mock_sendUsage(const QString &servicePath, const QVariantMap &home,
+        const QDBusMessage &message)
+{
+    if (m_counters.count() != 1) {
+        const QString err = QString("Expected one counter, got %1").arg(m_counters.count());
+        qWarning("%s: %s", Q_FUNC_INFO, qPrintable(err));
+        bus().send(message.createErrorReply(QDBusError::Failed, err));
+        return;
+    }
+
+    QDBusMessage usage = QDBusMessage::createMethodCall(m_counters.begin().value().service,
+            m_counters.begin().key(), "net.connman.Counter", "Usage");
+    usage << QVariant::fromValue(QDBusObjectPath(servicePath)) << home << QVariantMap();
+    bus().send(usage);
+}
+
+TEST_MAIN_WITH_MOCK(UtCounter, UtCounter::ManagerMock)
+
+#include "ut_counter.moc"
@@ -0,0 +1,186 @@
+#include "../libconnman-qt/counteraggregator.h"
+#include "testbase.h"
+
+namespace Tests {
+
+class UtCounterAggregator : public TestBase
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testFirstValuesAreBaseline();
+    void testDeltas();
+    void testCounterReset();
+    void testRoamingBaseline();
+    void testResolutions();
+    void testTechnologyUsage();
+    void testUtcOffset();
+
+private:
+    static QDateTime at(qint64 offset);
+    QVariantMap usage(const QString &service, qint64 from, qint64 to) const;
+
+private:
+    CounterAggregator *m_aggregator;
+};
+
+} // namespace Tests
+
+using namespace Tests;
+using namespace Tests::UsageFixtures;
+
+/*
+ * \class Tests::UtCounterAggregator
+ */
+
+void UtCounterAggregator::init()
+{
+    m_aggregator = new CounterAggregator(this);
+    m_aggregator->setUtcOffset(0);
+}
+
+void UtCounterAggregator::cleanup()
+{
+    delete m_aggregator;
+}
+
+void UtCounterAggregator::testFirstValuesAreBaseline()
+{
+    SignalSpy servicesChangedSpy(m_aggregator, SIGNAL(servicesChanged()));
+
+    m_aggregator->addUsage(Wifi, counters(5000, 1000, 60), false, Start);
+
+    QCOMPARE(servicesChangedSpy.count(), 1);
+    QCOMPARE(m_aggregator->services(), QStringList() << Wifi);
+
+    const QVariantMap total = usage(Wifi, 0, Minute);
+    QCOMPARE(total.value("RX.Bytes").toULongLong(), Q_UINT64_C(0));
+    QCOMPARE(total.value("TX.Bytes").toULongLong(), Q_UINT64_C(0));
+    QCOMPARE(total.value("Time").toULongLong(), Q_UINT64_C(0));
+}
+
+void UtCounterAggregator::testDeltas()
+{
+    m_aggregator->addUsage(Wifi, counters(5000, 1000, 60), false, Start);
+    m_aggregator->addUsage(Wifi, counters(6000, 1500, 65), false, Start + 1000);
+    m_aggregator->addUsage(Wifi, counters(8000, 1500, 70), false, Start + Minute);
+
+    // Missing values did not change
+    QVariantMap partial;
+    partial.insert("RX.Bytes", Q_UINT64_C(8500));
+    m_aggregator->addUsage(Wifi, partial, false, Start + 2 * Minute);
+
+    QCOMPARE(usage(Wifi, 0, Minute).value("RX.Bytes").toULongLong(), Q_UINT64_C(1000));
+    QCOMPARE(usage(Wifi, 0, Minute).value("TX.Bytes").toULongLong(), Q_UINT64_C(500));
+    QCOMPARE(usage(Wifi, Minute, 2 * Minute).value("RX.Bytes").toULongLong(), Q_UINT64_C(2000));
+    QCOMPARE(usage(Wifi, 0, 3 * Minute).value("RX.Bytes").toULongLong(), Q_UINT64_C(3500));
+    QCOMPARE(usage(Wifi, 0, 3 * Minute).value("Time").toULongLong(), Q_UINT64_C(10));
+}
+
+void UtCounterAggregator::testCounterReset()
+{
+    m_aggregator->addUsage(Wifi, counters(5000, 1000, 60), false, Start);
+    m_aggregator->addUsage(Wifi, counters(6000, 1000, 60), false, Start + 1000);
+    // connman starts over from zero
+    m_aggregator->addUsage(Wifi, counters(300, 200, 5), false, Start + 2000);
+    m_aggregator->addUsage(Wifi, counters(400, 200, 5), false, Start + 3000);
+
+    const QVariantMap total = usage(Wifi, 0, Minute);
+    QCOMPARE(total.value("RX.Bytes").toULongLong(), Q_UINT64_C(1400));
+    QCOMPARE(total.value("TX.Bytes").toULongLong(), Q_UINT64_C(200));
+    QCOMPARE(total.value("Time").toULongLong(), Q_UINT64_C(5));
+}
+
+void UtCounterAggregator::testRoamingBaseline()
+{
+    m_aggregator->addUsage(Cellular, counters(5000, 1000, 60), false, Start);
+    m_aggregator->addUsage(Cellular, counters(100, 100, 1), true, Start + 1000);
+    m_aggregator->addUsage(Cellular, counters(5100, 1000, 60), false, Start + 2000);
+    m_aggregator->addUsage(Cellular, counters(300, 100, 1), true, Start + 3000);
+
+    QCOMPARE(usage(Cellular, 0, Minute).value("RX.Bytes").toULongLong(), Q_UINT64_C(300));
+}
+
+void UtCounterAggregator::testResolutions()
+{
+    m_aggregator->addUsage(Wifi, counters(0, 0, 0), false, Start);
+    m_aggregator->addUsage(Wifi, counters(1000, 0, 0), false, Start + 10 * Minute);
+    m_aggregator->addUsage(Wifi, counters(3000, 0, 0), false, Start + 3 * Hour);
+
+    // The minute ring only reaches back an hour from the last sample
+    QCOMPARE(m_aggregator->history(Wifi, CounterAggregator::Minutes).count(), 60);
+    QCOMPARE(usage(Wifi, 3 * Hour, 4 * Hour).value("RX.Bytes").toULongLong(), Q_UINT64_C(2000));
+
+    // Older windows come from the hour ring, whole hours at a time
+    QCOMPARE(usage(Wifi, 5 * Minute, 15 * Minute).value("RX.Bytes").toULongLong(),
+             Q_UINT64_C(1000));
+    QCOMPARE(usage(Wifi, 0, 4 * Hour).value("RX.Bytes").toULongLong(), Q_UINT64_C(3000));
+
+    const QVariantList hours = m_aggregator->history(Wifi, CounterAggregator::Hours);
+    QCOMPARE(hours.count(), 48);
+    QCOMPARE(hours.last().toMap().value("Start").toDateTime(), at(3 * Hour));
+    QCOMPARE(hours.last().toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(2000));
+
+    const QVariantList days = m_aggregator->history(Wifi, CounterAggregator::Days);
+    QCOMPARE(days.last().toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(3000));
+}
+
+void UtCounterAggregator::testTechnologyUsage()
+{
+    m_aggregator->addUsage(Wifi, counters(0, 0, 0), false, Start);
+    m_aggregator->addUsage(Wifi, counters(1000, 10, 0), false, Start + 1000);
+    m_aggregator->addUsage(Cellular, counters(0, 0, 0), false, Start);
+    m_aggregator->addUsage(Cellular, counters(200, 20, 0), false, Start + 1000);
+
+    QCOMPARE(m_aggregator->technologyUsage("wifi", at(0), at(Minute)).value("RX.Bytes")
+             .toULongLong(), Q_UINT64_C(1000));
+    QCOMPARE(m_aggregator->technologyUsage("cellular", at(0), at(Minute)).value("TX.Bytes")
+             .toULongLong(), Q_UINT64_C(20));
+    QCOMPARE(m_aggregator->technologyUsage("bluetooth", at(0), at(Minute)).value("RX.Bytes")
+             .toULongLong(), Q_UINT64_C(0));
+}
+
+void UtCounterAggregator::testUtcOffset()
+{
+    SignalSpy utcOffsetChangedSpy(m_aggregator, SIGNAL(utcOffsetChanged(int)));
+    SignalSpy servicesChangedSpy(m_aggregator, SIGNAL(servicesChanged()));
+
+    m_aggregator->addUsage(Wifi, counters(0, 0, 0), false, Start);
+    m_aggregator->setUtcOffset(2 * 60 * 60);
+    QCOMPARE(utcOffsetChangedSpy.count(), 1);
+    QCOMPARE(m_aggregator->utcOffset(), 2 * 60 * 60);
+    QCOMPARE(m_aggregator->services(), QStringList());
+    QCOMPARE(servicesChangedSpy.count(), 2);
+
+    // 23:00 UTC is already the next day two hours east
+    m_aggregator->addUsage(Wifi, counters(0, 0, 0), false, Start);
+    m_aggregator->addUsage(Wifi, counters(1000, 0, 0), false, Start + 21 * Hour);
+    m_aggregator->addUsage(Wifi, counters(3000, 0, 0), false, Start + 23 * Hour);
+
+    const QVariantList days = m_aggregator->history(Wifi, CounterAggregator::Days);
+    QCOMPARE(days.at(days.count() - 2).toMap().value("Start").toDateTime(), at(-2 * Hour));
+    QCOMPARE(days.at(days.count() - 2).toMap().value("RX.Bytes").toULongLong(),
+             Q_UINT64_C(1000));
+    QCOMPARE(days.last().toMap().value("Start").toDateTime(), at(22 * Hour));
+    QCOMPARE(days.last().toMap().value("RX.Bytes").toULongLong(), Q_UINT64_C(2000));
+
+    const QVariantList hours = m_aggregator->history(Wifi, CounterAggregator::Hours);
+    QCOMPARE(hours.last().toMap().value("Start").toDateTime(), at(23 * Hour));
+}
+
+QDateTime UtCounterAggregator::at(qint64 offset)
+{
+    return QDateTime::fromMSecsSinceEpoch(Start + offset);
+}
+
+QVariantMap UtCounterAggregator::usage(const QString &service, qint64 from, qint64 to) const
+{
+    return m_aggregator->usage(service, at(from), at(to));
+}
+
+QTEST_MAIN(UtCounterAggregator)
+
+#include "ut_counteraggregator.moc"
@@ -0,0 +1,174 @@
+#include "testbase.h"
+
+namespace Tests {
+
+class UtDBusTypes : public TestBase
+{
+    Q_OBJECT
+
+    enum {
+        SERVICE_COUNT = 20,
+    };
+
+public:
+    class ManagerMock;
+
+private slots:
+    void initTestCase();
+
+    void testDecode();
+    void testOtherMaps();
+    void testSharedKeys();
+
+private:
+    static QDBusArgument getServices();
+    static QVariantMap serviceProperties();
+    static StringMap otherMap();
+};
+
+class UtDBusTypes::ManagerMock : public MainObjectMock
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.connman.Manager")
+
+public:
+    ManagerMock();
+
+public:
+    Q_SCRIPTABLE ConnmanObjectList GetServices() const;
+};
+
+} // namespace Tests
+
+using namespace Tests;
+
+/*
+ * \class Tests::UtDBusTypes
+ */
+
+void UtDBusTypes::initTestCase()
+{
+    registerCommonDataTypes();
+    QVERIFY(waitForService("net.connman", "/", "net.connman.Manager"));
+}
+
+void UtDBusTypes::testDecode()
+{
+    ConnmanObjectList objects;
+    getServices() >> objects;
+
+    QCOMPARE(objects.count(), (int)SERVICE_COUNT);
+
+    const QVariantMap expected = serviceProperties();
+    Q_FOREACH (const ConnmanObject &object, objects) {
+        QCOMPARE(object.properties.keys(), expected.keys());
+
+        QMapIterator<QString, QVariant> it(object.properties);
+        while (it.hasNext()) {
+            it.next();
+            if (it.key() != QLatin1String("Other"))
+                QVERIFY(it.value().userType() != qMetaTypeId<QDBusArgument>());
+        }
+
+        QCOMPARE(object.properties.value("IPv4").toMap(), expected.value("IPv4").toMap());
+        QCOMPARE(object.properties.value("Proxy.Configuration").toMap(),
+                expected.value("Proxy.Configuration").toMap());
+        QCOMPARE(object.properties.value("Name"), expected.value("Name"));
+        QCOMPARE(object.properties.value("Nameservers").toStringList(),
+                expected.value("Nameservers").toStringList());
+    }
+}
+
+// Only a{sv} dictionaries are decoded, other maps are left as they came
+void UtDBusTypes::testOtherMaps()
+{
+    ConnmanObjectList objects;
+    getServices() >> objects;
+    QVERIFY(!objects.isEmpty());
+
+    const QVariantMap &properties = objects.first().properties;
+    QVERIFY(properties.value("IPv4").userType() != qMetaTypeId<QDBusArgument>());
+
+    const QVariant other = properties.value("Other");
+    QCOMPARE(other.userType(), qMetaTypeId<QDBusArgument>());
+    QCOMPARE(other.value<QDBusArgument>().currentSignature(), QString("a{ss}"));
+    QCOMPARE(qdbus_cast<StringMap>(other), otherMap());
+}
+
+// Known keys share one string, also in the nested dictionaries
+void UtDBusTypes::testSharedKeys()
+{
+    ConnmanObjectList objects;
+    getServices() >> objects;
+    QVERIFY(objects.count() >= 2);
+
+    const QVariantMap &first = objects.at(0).properties;
+    const QVariantMap &second = objects.at(1).properties;
+
+    QCOMPARE(first.keys(), second.keys());
+    for (int i = 0; i < first.keys().count(); ++i) {
+        if (first.keys().at(i) == QLatin1String("Other"))
+            continue;
+        QVERIFY(first.keys().at(i).constData() == second.keys().at(i).constData());
+    }
+
+    const QStringList firstIpv4 = first.value("IPv4").toMap().keys();
+    const QStringList secondIpv4 = second.value("IPv4").toMap().keys();
+    QCOMPARE(firstIpv4, secondIpv4);
+    for (int i = 0; i < firstIpv4.count(); ++i)
+        QVERIFY(firstIpv4.at(i).constData() == secondIpv4.at(i).constData());
+}
+
+QDBusArgument UtDBusTypes::getServices()
+{
+    QDBusMessage call = QDBusMessage::createMethodCall("net.connman", "/",
+            "net.connman.Manager", "GetServices");
+    QDBusMessage reply = bus().call(call);
+
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().count() != 1) {
+        qWarning("%s: GetServices failed", Q_FUNC_INFO);
+        return QDBusArgument();
+    }
+
+    return reply.arguments().first().value<QDBusArgument>();
+}
+
+QVariantMap UtDBusTypes::serviceProperties()
+{
+    QVariantMap properties = defaultServiceProperties();
+    properties["Other"] = QVariant::fromValue(otherMap());
+    return properties;
+}
+
+StringMap UtDBusTypes::otherMap()
+{
+    StringMap map;
+    map["Host"] = "foo.org";
+    map["Port"] = "8080";
+    return map;
+}
+
+/*
+ * \class Tests::UtDBusTypes::ManagerMock
+ */
+
+UtDBusTypes::ManagerMock::ManagerMock()
+    : MainObjectMock("net.connman", "/")
+{
+}
+
+ConnmanObjectList UtDBusTypes::ManagerMock::GetServices() const
+{
+    ConnmanObjectList services;
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        ConnmanObject service;
+        service.objpath = QDBusObjectPath(QString("/net/connman/service/wifi_%1").arg(i));
+        service.properties = serviceProperties();
+        services.append(service);
+    }
+    return services;
+}
+
+TEST_MAIN_WITH_MOCK(UtDBusTypes, UtDBusTypes::ManagerMock)
+
+#include "ut_dbustypes.moc"
@@ -34,6 +34,13 @@ private slots:
     void testAddedTechnologyProperties();
     void testAvailabilityChanged();
     void testServiceRemoved();
+    void testServicePropertyChanged();
+    void testRemovedServiceRevived();
+    void testServicesMoved();
+    void testCoalesceChanges();
+    void testDBusThread();
+    void testTechnologyScanMetrics();
+    void testTechnologyScanResults();
     void testTechnologyRemoved();
     void testRegisterCounter();
 
@@ -66,6 +73,13 @@ public:
     Q_SCRIPTABLE void mock_addService(const QString &path, const QVariantMap &properties,
             const QDBusMessage &message);
     Q_SCRIPTABLE void mock_removeService(const QString &path, const QDBusMessage &message);
+    Q_SCRIPTABLE void mock_orderServices(const QStringList &paths);
+    Q_SCRIPTABLE void mock_updateService(const QString &path, const QVariantMap &properties);
+    Q_SCRIPTABLE void mock_updateAndChangeService(const QString &path, const QString &name,
+            const QString &updated, const QString &changed);
+    Q_SCRIPTABLE void mock_changeService(const QString &path, const QString &name,
+            const QDBusVariant &value);
+    Q_SCRIPTABLE void mock_setSavedServices(const QStringList &paths);
     Q_SCRIPTABLE void mock_addTechnology(const QString &path, const QVariantMap &properties,
             const QDBusMessage &message);
     Q_SCRIPTABLE void mock_removeTechnology(const QString &path, const QDBusMessage &message);
@@ -77,6 +91,7 @@ signals:
     Q_SCRIPTABLE void PropertyChanged(const QString &name, const QDBusVariant &value);
     Q_SCRIPTABLE void ServicesChanged(ConnmanObjectList changed,
             const QList<QDBusObjectPath> &removed);
+    Q_SCRIPTABLE void SavedServicesChanged(ConnmanObjectList changed);
     Q_SCRIPTABLE void TechnologyAdded(const QDBusObjectPath &path, const QVariantMap &properties);
     Q_SCRIPTABLE void TechnologyRemoved(const QDBusObjectPath &path);
 
@@ -101,6 +116,15 @@ public:
 
     QVariantMap properties() const { return m_properties; }
 
+    void changeProperty(const QString &name, const QVariant &value)
+    {
+        m_properties[name] = value;
+        Q_EMIT PropertyChanged(name, QDBusVariant(value));
+    }
+
+signals:
+    Q_SCRIPTABLE void PropertyChanged(const QString &name, const QDBusVariant &value);
+
 private:
     QVariantMap m_properties;
 };
@@ -113,14 +137,29 @@ class UtManager::TechnologyMock : public QObject
 public:
     TechnologyMock(const QVariantMap &properties, ManagerMock *manager)
         : QObject(manager),
-          m_properties(properties)
+          m_properties(properties),
+          m_getPropertiesCount(0)
     {
     }
 
     QVariantMap properties() const { return m_properties; }
 
+    Q_SCRIPTABLE QVariantMap GetProperties()
+    {
+        ++m_getPropertiesCount;
+        return m_properties;
+    }
+
+    Q_SCRIPTABLE void Scan()
+    {
+    }
+
+    // mock API
+    Q_SCRIPTABLE int mock_getPropertiesCount() const { return m_getPropertiesCount; }
+
 private:
     QVariantMap m_properties;
+    int m_getPropertiesCount;
 };
 
 } // namespace Tests
@@ -203,6 +242,7 @@ void UtManager::testServiceAdded()
 
     SignalSpy servicesChangedSpy(m_manager, SIGNAL(servicesChanged()));
     SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+    SignalSpy servicesInsertedSpy(m_manager, SIGNAL(servicesInserted(int,int)));
 
     const QString injectedServicePath = "/service_just_added";
     const QVariantMap injectedServiceProperties = defaultServiceProperties();
@@ -218,6 +258,10 @@ void UtManager::testServiceAdded()
     QCOMPARE(serviceAddedSpy.count(), 1);
     QCOMPARE(serviceAddedSpy.at(0).at(0).toString(), injectedServicePath);
 
+    QCOMPARE(servicesInsertedSpy.count(), 1);
+    QCOMPARE(servicesInsertedSpy.at(0).at(0).toInt(), 0);
+    QCOMPARE(servicesInsertedSpy.at(0).at(1).toInt(), 0);
+
     const QVector<NetworkService *> services = m_manager->getServices();
     QCOMPARE(services.count(), 1);
     QCOMPARE(services.at(0)->path(), injectedServicePath);
@@ -272,6 +316,16 @@ void UtManager::testTechnologyAdded()
     QCOMPARE(m_manager->technologyPathForType(injectedTechnologyType), injectedTechnologyPath);
 
     QCOMPARE(m_manager->technologiesList(), QStringList() << injectedTechnologyType);
+
+    // Seeded with the properties from TechnologyAdded, still reports ready
+    SignalSpy propertiesReadySpy(technology, SIGNAL(propertiesReady()));
+    QVERIFY(waitForSignal(&propertiesReadySpy));
+
+    QDBusInterface technologyMock("net.connman", injectedTechnologyPath,
+            "net.connman.Technology", bus());
+    QDBusReply<int> getPropertiesCount = technologyMock.call("mock_getPropertiesCount");
+    QVERIFY2(getPropertiesCount.isValid(), qPrintable(getPropertiesCount.error().message()));
+    QCOMPARE(getPropertiesCount.value(), 0);
 }
 
 void UtManager::testAddedTechnologyProperties_data()
@@ -314,6 +368,7 @@ void UtManager::testServiceRemoved()
 
     SignalSpy servicesChangedSpy(m_manager, SIGNAL(servicesChanged()));
     SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    SignalSpy servicesRemovedSpy(m_manager, SIGNAL(servicesRemoved(int,int)));
 
     const QString injectedServicePath = "/service_just_added";
 
@@ -326,10 +381,296 @@ void UtManager::testServiceRemoved()
     QCOMPARE(serviceRemovedSpy.count(), 1);
     QCOMPARE(serviceRemovedSpy.at(0).at(0).toString(), injectedServicePath);
 
+    QCOMPARE(servicesRemovedSpy.count(), 1);
+    QCOMPARE(servicesRemovedSpy.at(0).at(0).toInt(), 0);
+    QCOMPARE(servicesRemovedSpy.at(0).at(1).toInt(), 0);
+
     const QVector<NetworkService *> services = m_manager->getServices();
     QCOMPARE(services.count(), 0);
 }
 
+void UtManager::testServicePropertyChanged()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QStringList paths = QStringList() << "/service_a" << "/service_b";
+
+    SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+    Q_FOREACH (const QString &path, paths) {
+        manager.asyncCall("mock_addService", path, defaultServiceProperties());
+        QVERIFY(waitForSignal(&serviceAddedSpy));
+        serviceAddedSpy.clear();
+    }
+
+    NetworkService *changed = 0;
+    NetworkService *unchanged = 0;
+    Q_FOREACH (NetworkService *service, m_manager->getServices()) {
+        if (service->path() == paths.at(0))
+            changed = service;
+        else if (service->path() == paths.at(1))
+            unchanged = service;
+    }
+    QVERIFY(changed);
+    QVERIFY(unchanged);
+
+    // Managed services are fed by the manager and open no proxy of their own
+    QVERIFY(changed->m_managed);
+    QVERIFY(unchanged->m_managed);
+    QVERIFY(!changed->m_service);
+    QVERIFY(!unchanged->m_service);
+
+    SignalSpy changedSpy(changed, SIGNAL(nameChanged(QString)));
+    SignalSpy unchangedSpy(unchanged, SIGNAL(nameChanged(QString)));
+    manager.asyncCall("mock_changeService", paths.at(0), "Name",
+            QVariant::fromValue(QDBusVariant(QString("changed"))));
+    QVERIFY(waitForSignal(&changedSpy));
+    QTest::qWait(500);
+
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(changed->name(), QString("changed"));
+    QCOMPARE(unchangedSpy.count(), 0);
+    QCOMPARE(unchanged->name(), defaultServiceProperties().value("Name").toString());
+    QVERIFY(!changed->m_service);
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    Q_FOREACH (const QString &path, paths) {
+        manager.asyncCall("mock_removeService", path);
+        QVERIFY(waitForSignal(&serviceRemovedSpy));
+        serviceRemovedSpy.clear();
+    }
+}
+
+void UtManager::testRemovedServiceRevived()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QString injectedServicePath = "/service_coming_back";
+
+    SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+    manager.asyncCall("mock_addService", injectedServicePath, defaultServiceProperties());
+    QVERIFY(waitForSignal(&serviceAddedSpy));
+
+    QPointer<NetworkService> service = m_manager->getServices().value(0);
+    QVERIFY(service);
+    QCOMPARE(service->path(), injectedServicePath);
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    manager.asyncCall("mock_removeService", injectedServicePath);
+    QVERIFY(waitForSignal(&serviceRemovedSpy));
+    QCOMPARE(m_manager->getServices().count(), 0);
+
+    // Comes back as the same object, with the new properties
+    serviceAddedSpy.clear();
+    SignalSpy nameChangedSpy(service, SIGNAL(nameChanged(QString)));
+    manager.asyncCall("mock_addService", injectedServicePath,
+            alternateDefaultServiceProperties());
+    QVERIFY(waitForSignal(&serviceAddedSpy));
+
+    QVERIFY(service);
+    QCOMPARE(m_manager->getServices().value(0), service.data());
+    QCOMPARE(nameChangedSpy.count(), 1);
+    QCOMPARE(service->name(), alternateDefaultServiceProperties().value("Name").toString());
+
+    serviceRemovedSpy.clear();
+    manager.asyncCall("mock_removeService", injectedServicePath);
+    QVERIFY(waitForSignal(&serviceRemovedSpy));
+}
+
+void UtManager::testServicesMoved()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QStringList paths = QStringList() << "/service_a" << "/service_b" << "/service_c"
+        << "/service_d";
+
+    SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+    Q_FOREACH (const QString &path, paths) {
+        manager.asyncCall("mock_addService", path, defaultServiceProperties());
+        QVERIFY(waitForSignal(&serviceAddedSpy));
+        serviceAddedSpy.clear();
+    }
+
+    SignalSpy servicesChangedSpy(m_manager, SIGNAL(servicesChanged()));
+    manager.asyncCall("mock_orderServices", paths);
+    QVERIFY(waitForSignal(&servicesChangedSpy));
+    QCOMPARE(m_manager->servicesList(QString()), paths);
+
+    SignalSpy servicesInsertedSpy(m_manager, SIGNAL(servicesInserted(int,int)));
+    SignalSpy servicesRemovedSpy(m_manager, SIGNAL(servicesRemoved(int,int)));
+    SignalSpy servicesMovedSpy(m_manager, SIGNAL(servicesMoved(int,int)));
+
+    // Only the one service which changed its place is moved
+    const QStringList reordered = QStringList() << "/service_b" << "/service_c"
+        << "/service_d" << "/service_a";
+    servicesChangedSpy.clear();
+    manager.asyncCall("mock_orderServices", reordered);
+    QVERIFY(waitForSignal(&servicesChangedSpy));
+    QCOMPARE(m_manager->servicesList(QString()), reordered);
+
+    QCOMPARE(servicesInsertedSpy.count(), 0);
+    QCOMPARE(servicesRemovedSpy.count(), 0);
+    QCOMPARE(servicesMovedSpy.count(), 1);
+    QCOMPARE(servicesMovedSpy.at(0).at(0).toInt(), 0);
+    QCOMPARE(servicesMovedSpy.at(0).at(1).toInt(), 3);
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    Q_FOREACH (const QString &path, paths) {
+        manager.asyncCall("mock_removeService", path);
+        QVERIFY(waitForSignal(&serviceRemovedSpy));
+        serviceRemovedSpy.clear();
+    }
+}
+
+void UtManager::testCoalesceChanges()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QString path = "/service_coalesced";
+
+    m_manager->setCoalesceInterval(500);
+    m_manager->setCoalesceChanges(true);
+
+    SignalSpy servicesChangedSpy(m_manager, SIGNAL(servicesChanged()));
+    SignalSpy servicesListChangedSpy(m_manager, SIGNAL(servicesListChanged(QStringList)));
+    SignalSpy servicesInsertedSpy(m_manager, SIGNAL(servicesInserted(int,int)));
+    SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+
+    manager.asyncCall("mock_addService", path, defaultServiceProperties());
+    QVERIFY(waitForSignal(&serviceAddedSpy));
+
+    // The index based signals are never held back
+    QCOMPARE(servicesInsertedSpy.count(), 1);
+    QCOMPARE(servicesChangedSpy.count(), 0);
+
+    QVERIFY(waitForSignal(&servicesChangedSpy));
+    QCOMPARE(servicesChangedSpy.count(), 1);
+    QCOMPARE(servicesListChangedSpy.count(), 1);
+    QCOMPARE(servicesListChangedSpy.at(0).at(0).toStringList(), QStringList() << path);
+
+    NetworkService *const service = m_manager->getServices().value(0);
+    QVERIFY(service);
+    QCOMPARE(m_manager->getServices("wifi").count(), 1);
+
+    // The buckets follow the stored values before their signals are out
+    m_manager->setCoalesceInterval(60000);
+    SignalSpy typeChangedSpy(service, SIGNAL(typeChanged(QString)));
+    SignalSpy savedServicesChangedSpy(m_manager, SIGNAL(savedServicesChanged()));
+
+    manager.asyncCall("mock_setSavedServices", QStringList() << path);
+    QTest::qWait(500);
+    QCOMPARE(m_manager->getSavedServices("wifi").count(), 0);
+
+    QVariantMap properties;
+    properties["Type"] = "ethernet";
+    properties["Favorite"] = true;
+    manager.asyncCall("mock_updateService", path, properties);
+    QTest::qWait(500);
+
+    QCOMPARE(service->type(), QString("ethernet"));
+    QCOMPARE(typeChangedSpy.count(), 0);
+    QCOMPARE(savedServicesChangedSpy.count(), 0);
+    QCOMPARE(m_manager->getServices("wifi").count(), 0);
+    QCOMPARE(m_manager->getServices("ethernet").count(), 1);
+    QCOMPARE(m_manager->getSavedServices("ethernet").count(), 1);
+
+    // Turning it off flushes what is still pending
+    m_manager->setCoalesceChanges(false);
+    QCOMPARE(typeChangedSpy.count(), 1);
+    QCOMPARE(savedServicesChangedSpy.count(), 1);
+    m_manager->setCoalesceInterval(0);
+
+    savedServicesChangedSpy.clear();
+    manager.asyncCall("mock_setSavedServices", QStringList());
+    QVERIFY(waitForSignal(&savedServicesChangedSpy));
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    manager.asyncCall("mock_removeService", path);
+    QVERIFY(waitForSignal(&serviceRemovedSpy));
+}
+
+void UtManager::testDBusThread()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QString path = "/service_threaded";
+
+    m_manager->setDBusThreadEnabled(true);
+
+    SignalSpy serviceAddedSpy(m_manager, SIGNAL(serviceAdded(QString)));
+    manager.asyncCall("mock_addService", path, defaultServiceProperties());
+    QVERIFY(waitForSignal(&serviceAddedSpy));
+
+    NetworkService *const service = m_manager->getServices().value(0);
+    QVERIFY(service);
+    QCOMPARE(service->path(), path);
+
+    // The property change sent last is the one that stays
+    SignalSpy nameChangedSpy(service, SIGNAL(nameChanged(QString)));
+    manager.asyncCall("mock_updateAndChangeService", path, "Name", "updated", "changed");
+    QVERIFY(waitForSignal(&nameChangedSpy));
+    QTest::qWait(500);
+    QCOMPARE(nameChangedSpy.count(), 2);
+    QCOMPARE(service->name(), QString("changed"));
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    manager.asyncCall("mock_removeService", path);
+    QVERIFY(waitForSignal(&serviceRemovedSpy));
+
+    m_manager->setDBusThreadEnabled(false);
+}
+
+void UtManager::testTechnologyScanMetrics()
+{
+    NetworkTechnology *const technology = m_manager->getTechnology(
+            defaultTechnologyProperties()["Type"].toString());
+    QVERIFY(technology != 0);
+
+    technology->setScanMetricsEnabled(true);
+
+    SignalSpy scanFinishedSpy(technology, SIGNAL(scanFinished()));
+    SignalSpy scanMeasuredSpy(technology, SIGNAL(scanMeasured(QVariantMap)));
+    technology->scan();
+
+    // No ServicesChanged follows the scan, it is booked once it settled
+    QVERIFY(waitForSignal(&scanFinishedSpy));
+    QCOMPARE(scanMeasuredSpy.count(), 0);
+    QVERIFY(waitForSignal(&scanMeasuredSpy));
+
+    const QVariantMap record = scanMeasuredSpy.at(0).at(0).toMap();
+    QCOMPARE(record.value("error").toString(), QString());
+    QCOMPARE(record.value("servicesAdded").toInt(), 0);
+    QCOMPARE(record.value("servicesRemoved").toInt(), 0);
+    QCOMPARE(technology->scanMetrics().value("scans").toInt(), 1);
+
+    technology->setScanMetricsEnabled(false);
+}
+
+void UtManager::testTechnologyScanResults()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+
+    const QString type = defaultTechnologyProperties()["Type"].toString();
+    NetworkTechnology *const technology = m_manager->getTechnology(type);
+    QVERIFY(technology != 0);
+
+    SignalSpy scanFinishedSpy(technology, SIGNAL(scanFinished()));
+    technology->scan();
+    QVERIFY(waitForSignal(&scanFinishedSpy));
+    QCOMPARE(technology->lastScanResults(), m_manager->getServices(type).count());
+
+    // What the scan found comes after its reply
+    const QString path = "/service_found_by_scan";
+    SignalSpy lastScanResultsChangedSpy(technology, SIGNAL(lastScanResultsChanged(int)));
+    manager.asyncCall("mock_addService", path, defaultServiceProperties());
+    QVERIFY(waitForSignal(&lastScanResultsChangedSpy));
+    QCOMPARE(technology->lastScanResults(), m_manager->getServices(type).count());
+    QVERIFY(technology->lastScanResults() > 0);
+
+    SignalSpy serviceRemovedSpy(m_manager, SIGNAL(serviceRemoved(QString)));
+    manager.asyncCall("mock_removeService", path);
+    QVERIFY(waitForSignal(&serviceRemovedSpy));
+}
+
 void UtManager::testTechnologyRemoved()
 {
     QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
@@ -529,6 +870,71 @@ void UtManager::ManagerMock::mock_removeService(const QString &path, const QDBus
     Q_EMIT ServicesChanged(ConnmanObjectList(), QList<QDBusObjectPath>() << QDBusObjectPath(path));
 }
 
+void UtManager::ManagerMock::mock_orderServices(const QStringList &paths)
+{
+    ConnmanObjectList services;
+    Q_FOREACH (const QString &path, paths) {
+        ConnmanObject object = {
+            QDBusObjectPath(path),
+            QVariantMap(),
+        };
+
+        services.append(object);
+    }
+
+    Q_EMIT ServicesChanged(services, QList<QDBusObjectPath>());
+}
+
+void UtManager::ManagerMock::mock_updateService(const QString &path,
+        const QVariantMap &properties)
+{
+    ConnmanObject object = {
+        QDBusObjectPath(path),
+        properties,
+    };
+
+    Q_EMIT ServicesChanged(ConnmanObjectList() << object, QList<QDBusObjectPath>());
+}
+
+void UtManager::ManagerMock::mock_updateAndChangeService(const QString &path,
+        const QString &name, const QString &updated, const QString &changed)
+{
+    ServiceMock *const service = m_services.value(path);
+    if (!service)
+        return;
+
+    QVariantMap properties;
+    properties[name] = updated;
+    mock_updateService(path, properties);
+
+    service->changeProperty(name, changed);
+}
+
+void UtManager::ManagerMock::mock_changeService(const QString &path, const QString &name,
+        const QDBusVariant &value)
+{
+    ServiceMock *const service = m_services.value(path);
+    if (!service)
+        return;
+
+    service->changeProperty(name, value.variant());
+}
+
+void UtManager::ManagerMock::mock_setSavedServices(const QStringList &paths)
+{
+    ConnmanObjectList services;
+    Q_FOREACH (const QString &path, paths) {
+        ConnmanObject object = {
+            QDBusObjectPath(path),
+            QVariantMap(),
+        };
+
+        services.append(object);
+    }
+
+    Q_EMIT SavedServicesChanged(services);
+}
+
 void UtManager::ManagerMock::mock_addTechnology(const QString &path, const QVariantMap &properties,
         const QDBusMessage &message)
 {
@@ -0,0 +1,286 @@
+#include "../libconnman-qt/networkmanager.h"
+#include "../plugin/savedservicemodel.h"
+#include "../plugin/technologymodel.h"
+#include "testbase.h"
+
+namespace Tests {
+
+class UtModels : public TestBase
+{
+    Q_OBJECT
+
+public:
+    class ManagerMock;
+
+public:
+    UtModels();
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void testTechnologyModelRows();
+    void testSavedServiceModelRows();
+
+private:
+    static void setServices(const QStringList &paths);
+    static void setSavedServices(const QStringList &paths);
+    static void compareRows(const ServiceListModel &model, const QStringList &paths);
+
+    NetworkManager *m_manager;
+};
+
+class UtModels::ManagerMock : public MainObjectMock
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.connman.Manager")
+
+public:
+    ManagerMock();
+
+public:
+    Q_SCRIPTABLE QVariantMap GetProperties() const;
+    Q_SCRIPTABLE ConnmanObjectList GetTechnologies() const;
+    Q_SCRIPTABLE ConnmanObjectList GetServices() const;
+    Q_SCRIPTABLE ConnmanObjectList GetSavedServices() const;
+
+    // mock API
+    Q_SCRIPTABLE void mock_setServices(const QStringList &paths);
+    Q_SCRIPTABLE void mock_setSavedServices(const QStringList &paths);
+
+signals:
+    Q_SCRIPTABLE void ServicesChanged(ConnmanObjectList changed,
+            const QList<QDBusObjectPath> &removed);
+    Q_SCRIPTABLE void SavedServicesChanged(ConnmanObjectList changed);
+
+private:
+    static ConnmanObjectList services(const QStringList &paths);
+
+    QStringList m_services;
+    QStringList m_savedServices;
+};
+
+} // namespace Tests
+
+using namespace Tests;
+
+/*
+ * \class Tests::UtModels
+ */
+
+UtModels::UtModels()
+    : m_manager(NULL)
+{
+    qRegisterMetaType<QModelIndex>("QModelIndex"); // needed by SignalSpy
+}
+
+void UtModels::initTestCase()
+{
+    QVERIFY(waitForService("net.connman", "/", "net.connman.Manager"));
+
+    m_manager = NetworkManagerFactory::createInstance();
+    if (m_manager->technologiesList().isEmpty())
+        QVERIFY(waitForSignal(m_manager, SIGNAL(technologiesChanged())));
+    QCOMPARE(m_manager->technologiesList(), QStringList() << "wifi");
+}
+
+void UtModels::cleanup()
+{
+    setSavedServices(QStringList());
+    setServices(QStringList());
+}
+
+void UtModels::testTechnologyModelRows()
+{
+    TechnologyModel model;
+    model.setName("wifi");
+    QCOMPARE(model.count(), 0);
+
+    SignalSpy rowsInsertedSpy(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    SignalSpy rowsRemovedSpy(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    SignalSpy rowsMovedSpy(&model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    // New services come in as one range
+    const QStringList paths = QStringList() << "/service_a" << "/service_b" << "/service_c"
+        << "/service_d";
+    setServices(paths);
+    QVERIFY(waitForSignal(&rowsInsertedSpy));
+    QCOMPARE(rowsInsertedSpy.count(), 1);
+    QCOMPARE(rowsInsertedSpy.at(0).at(1).toInt(), 0);
+    QCOMPARE(rowsInsertedSpy.at(0).at(2).toInt(), 3);
+    compareRows(model, paths);
+
+    // Only the one service which changed its place is moved
+    rowsInsertedSpy.clear();
+    const QStringList reordered = QStringList() << "/service_b" << "/service_c"
+        << "/service_d" << "/service_a";
+    setServices(reordered);
+    QVERIFY(waitForSignal(&rowsMovedSpy));
+    QCOMPARE(rowsMovedSpy.count(), 1);
+    QCOMPARE(rowsMovedSpy.at(0).at(1).toInt(), 0);
+    QCOMPARE(rowsMovedSpy.at(0).at(2).toInt(), 0);
+    QCOMPARE(rowsMovedSpy.at(0).at(4).toInt(), 4);
+    QCOMPARE(rowsInsertedSpy.count(), 0);
+    QCOMPARE(rowsRemovedSpy.count(), 0);
+    compareRows(model, reordered);
+
+    // Removed and added in one go, the rows between are not moved
+    rowsMovedSpy.clear();
+    const QStringList replaced = QStringList() << "/service_c" << "/service_d"
+        << "/service_a" << "/service_e";
+    setServices(replaced);
+    QVERIFY(waitForSignal(&rowsInsertedSpy));
+    QCOMPARE(rowsRemovedSpy.count(), 1);
+    QCOMPARE(rowsRemovedSpy.at(0).at(1).toInt(), 0);
+    QCOMPARE(rowsRemovedSpy.at(0).at(2).toInt(), 0);
+    QCOMPARE(rowsInsertedSpy.count(), 1);
+    QCOMPARE(rowsInsertedSpy.at(0).at(1).toInt(), 3);
+    QCOMPARE(rowsInsertedSpy.at(0).at(2).toInt(), 3);
+    QCOMPARE(rowsMovedSpy.count(), 0);
+    compareRows(model, replaced);
+    QCOMPARE(model.indexOf("/service_b"), -1);
+}
+
+void UtModels::testSavedServiceModelRows()
+{
+    SavedServiceModel model;
+    model.setName("wifi");
+    QCOMPARE(model.rowCount(), 0);
+
+    SignalSpy rowsInsertedSpy(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    SignalSpy rowsRemovedSpy(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    SignalSpy rowsMovedSpy(&model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    const QStringList paths = QStringList() << "/service_a" << "/service_c" << "/service_d";
+    setSavedServices(paths);
+    QVERIFY(waitForSignal(&rowsInsertedSpy));
+    QCOMPARE(rowsInsertedSpy.count(), 1);
+    QCOMPARE(rowsInsertedSpy.at(0).at(1).toInt(), 0);
+    QCOMPARE(rowsInsertedSpy.at(0).at(2).toInt(), 2);
+    compareRows(model, paths);
+
+    const QStringList reordered = QStringList() << "/service_d" << "/service_a"
+        << "/service_c";
+    setSavedServices(reordered);
+    QVERIFY(waitForSignal(&rowsMovedSpy));
+    QCOMPARE(rowsMovedSpy.count(), 1);
+    QCOMPARE(rowsMovedSpy.at(0).at(1).toInt(), 2);
+    QCOMPARE(rowsMovedSpy.at(0).at(2).toInt(), 2);
+    QCOMPARE(rowsMovedSpy.at(0).at(4).toInt(), 0);
+    compareRows(model, reordered);
+
+    rowsMovedSpy.clear();
+    rowsInsertedSpy.clear();
+    const QStringList shortened = QStringList() << "/service_d" << "/service_c";
+    setSavedServices(shortened);
+    QVERIFY(waitForSignal(&rowsRemovedSpy));
+    QCOMPARE(rowsRemovedSpy.count(), 1);
+    QCOMPARE(rowsRemovedSpy.at(0).at(1).toInt(), 1);
+    QCOMPARE(rowsRemovedSpy.at(0).at(2).toInt(), 1);
+    QCOMPARE(rowsInsertedSpy.count(), 0);
+    QCOMPARE(rowsMovedSpy.count(), 0);
+    compareRows(model, shortened);
+    QCOMPARE(model.indexOf("/service_a"), -1);
+}
+
+void UtModels::setServices(const QStringList &paths)
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+    QDBusReply<void> reply = manager.call("mock_setServices", paths);
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+}
+
+void UtModels::setSavedServices(const QStringList &paths)
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+    QDBusReply<void> reply = manager.call("mock_setSavedServices", paths);
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+}
+
+void UtModels::compareRows(const ServiceListModel &model, const QStringList &paths)
+{
+    QCOMPARE(model.rowCount(), paths.count());
+    for (int i = 0; i < paths.count(); ++i) {
+        const QModelIndex index = model.index(i, 0);
+        QObject *service = model.data(index, TechnologyModel::ServiceRole).value<QObject *>();
+        QVERIFY(service);
+        QCOMPARE(service->property("path").toString(), paths.at(i));
+        QCOMPARE(model.indexOf(paths.at(i)), i);
+    }
+}
+
+/*
+ * \class Tests::UtModels::ManagerMock
+ */
+
+UtModels::ManagerMock::ManagerMock()
+    : MainObjectMock("net.connman", "/")
+{
+}
+
+QVariantMap UtModels::ManagerMock::GetProperties() const
+{
+    return defaultManagerProperties();
+}
+
+ConnmanObjectList UtModels::ManagerMock::GetTechnologies() const
+{
+    ConnmanObject object = {
+        QDBusObjectPath("/technology_wifi"),
+        defaultTechnologyProperties(),
+    };
+
+    return ConnmanObjectList() << object;
+}
+
+ConnmanObjectList UtModels::ManagerMock::GetServices() const
+{
+    return services(m_services);
+}
+
+ConnmanObjectList UtModels::ManagerMock::GetSavedServices() const
+{
+    return services(m_savedServices);
+}
+
+void UtModels::ManagerMock::mock_setServices(const QStringList &paths)
+{
+    QList<QDBusObjectPath> removed;
+    Q_FOREACH (const QString &path, m_services) {
+        if (!paths.contains(path))
+            removed.append(QDBusObjectPath(path));
+    }
+
+    m_services = paths;
+
+    Q_EMIT ServicesChanged(services(paths), removed);
+}
+
+void UtModels::ManagerMock::mock_setSavedServices(const QStringList &paths)
+{
+    m_savedServices = paths;
+
+    Q_EMIT SavedServicesChanged(services(paths));
+}
+
+ConnmanObjectList UtModels::ManagerMock::services(const QStringList &paths)
+{
+    ConnmanObjectList services;
+    Q_FOREACH (const QString &path, paths) {
+        QVariantMap properties = defaultServiceProperties();
+        properties["Name"] = path;
+
+        ConnmanObject object = {
+            QDBusObjectPath(path),
+            properties,
+        };
+
+        services.append(object);
+    }
+
+    return services;
+}
+
+TEST_MAIN_WITH_MOCK(UtModels, UtModels::ManagerMock)
+
+#include "ut_models.moc"
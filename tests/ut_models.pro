@@ -0,0 +1,12 @@
+include(testapplication.pri)
+
+# The models are built into the QML plugin, so they are tested from source
+INCLUDEPATH += ../libconnman-qt
+HEADERS += \
+    ../plugin/servicelistmodel.h \
+    ../plugin/technologymodel.h \
+    ../plugin/savedservicemodel.h
+SOURCES += \
+    ../plugin/servicelistmodel.cpp \
+    ../plugin/technologymodel.cpp \
+    ../plugin/savedservicemodel.cpp
@@ -0,0 +1,262 @@
+#include <QtCore/QTemporaryFile>
+
+#include <string.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+
+#include "../libconnman-qt/routemonitor.h"
+#include "testbase.h"
+
+namespace Tests {
+
+class UtRouteMonitor : public TestBase
+{
+    Q_OBJECT
+
+private slots:
+    void testLowestMetric();
+    void testPppRoute();
+    void testIpv6Fallback();
+    void testNoDefaultRoute();
+    void testLongTable();
+    void testReplacedRoute();
+    void testMultipathRoute();
+
+private:
+    static QByteArray ipv4Route(const char *iface, const char *destination, int flags,
+                                int metric);
+    static QByteArray ipv6Route(const char *destination, int flags, int metric,
+                                const char *iface);
+    static QString scan(const QByteArray &ipv4Table, const QByteArray &ipv6Table);
+    static QByteArray routeMessage(int type, int flags, int index, quint32 metric,
+                                   bool multipath = false);
+    static void appendAttribute(QByteArray *message, int type, const void *data, int length);
+    static void reset(RouteMonitor *monitor);
+    static QString feed(RouteMonitor *monitor, QByteArray messages);
+};
+
+} // namespace Tests
+
+using namespace Tests;
+
+namespace {
+
+const char *const Ipv4Header =
+    "Iface\tDestination\tGateway \tFlags\tRefCnt\tUse\tMetric\tMask\t\tMTU\tWindow\tIRTT\n";
+
+const char *const AnyAddress = "00000000";
+const char *const LocalNetwork = "0002A8C0";
+
+const int Up = 0x0001;
+const int Gateway = 0x0002;
+const int Reject = 0x0200;
+
+// No interface has this index
+const int Missing = 0x7fffffff;
+
+}
+
+/*
+ * \class Tests::UtRouteMonitor
+ */
+
+void UtRouteMonitor::testLowestMetric()
+{
+    QByteArray ipv4(Ipv4Header);
+    ipv4 += ipv4Route("wlan0", AnyAddress, Up | Gateway, 600);
+    ipv4 += ipv4Route("eth0", LocalNetwork, Up | Gateway, 0);
+    ipv4 += ipv4Route("eth0", AnyAddress, Up | Gateway, 100);
+    ipv4 += ipv4Route("rndis0", AnyAddress, Up, 50);
+
+    QCOMPARE(scan(ipv4, QByteArray()), QString("eth0"));
+}
+
+void UtRouteMonitor::testPppRoute()
+{
+    QByteArray ipv4(Ipv4Header);
+    ipv4 += ipv4Route("wlan0", AnyAddress, Up | Gateway, 600);
+    ipv4 += ipv4Route("ppp0", AnyAddress, Up, 0);
+
+    QCOMPARE(scan(ipv4, QByteArray()), QString("ppp0"));
+}
+
+void UtRouteMonitor::testIpv6Fallback()
+{
+    QByteArray ipv4(Ipv4Header);
+    ipv4 += ipv4Route("wlan0", LocalNetwork, Up, 0);
+
+    QByteArray ipv6;
+    ipv6 += ipv6Route("fe800000000000000000000000000000", Up, 256, "wlan0");
+    ipv6 += ipv6Route("00000000000000000000000000000000", Up | Reject, 0, "lo");
+    ipv6 += ipv6Route("00000000000000000000000000000000", Up | Gateway, 1024, "rmnet0");
+    ipv6 += ipv6Route("00000000000000000000000000000000", Up | Gateway, 600, "wlan0");
+
+    QCOMPARE(scan(ipv4, ipv6), QString("wlan0"));
+
+    // IPv4 default routes take precedence
+    ipv4 += ipv4Route("eth0", AnyAddress, Up | Gateway, 1000);
+    QCOMPARE(scan(ipv4, ipv6), QString("eth0"));
+}
+
+void UtRouteMonitor::testNoDefaultRoute()
+{
+    QByteArray ipv4(Ipv4Header);
+    ipv4 += ipv4Route("eth0", LocalNetwork, Up, 0);
+    ipv4 += ipv4Route("eth1", AnyAddress, Gateway, 0);
+
+    QCOMPARE(scan(ipv4, QByteArray()), QString());
+    QCOMPARE(RouteMonitor::scanRouteTables("/nonexistent/route", "/nonexistent/ipv6_route"),
+             QString());
+}
+
+void UtRouteMonitor::testLongTable()
+{
+    // Several times the reader's buffer, the best route last and without
+    // a line feed
+    QByteArray ipv4(Ipv4Header);
+    for (int i = 0; i < 64; ++i)
+        ipv4 += ipv4Route("wlan0", LocalNetwork, Up, i);
+    ipv4 += ipv4Route("wlan0", AnyAddress, Up | Gateway, 600);
+    ipv4 += ipv4Route("rmnet0", AnyAddress, Up | Gateway, 1);
+    ipv4.chop(1);
+
+    QVERIFY(ipv4.size() > 2048);
+    QCOMPARE(scan(ipv4, QByteArray()), QString("rmnet0"));
+}
+
+void UtRouteMonitor::testReplacedRoute()
+{
+    const int loopback = if_nametoindex("lo");
+    QVERIFY(loopback > 0);
+
+    RouteMonitor monitor;
+    reset(&monitor);
+
+    QCOMPARE(feed(&monitor, routeMessage(RTM_NEWROUTE, 0, Missing, 100)), QString());
+    QCOMPARE(monitor.m_routes.count(), 1);
+
+    // Moves the route with that metric instead of adding one beside it
+    QCOMPARE(feed(&monitor, routeMessage(RTM_NEWROUTE, NLM_F_REPLACE, loopback, 100)),
+             QString("lo"));
+    QCOMPARE(monitor.m_routes.count(), 1);
+
+    QCOMPARE(feed(&monitor, routeMessage(RTM_DELROUTE, 0, loopback, 100)), QString());
+    QCOMPARE(monitor.m_routes.count(), 0);
+}
+
+void UtRouteMonitor::testMultipathRoute()
+{
+    const int loopback = if_nametoindex("lo");
+    QVERIFY(loopback > 0);
+
+    RouteMonitor monitor;
+    reset(&monitor);
+
+    QCOMPARE(feed(&monitor, routeMessage(RTM_NEWROUTE, 0, loopback, 0, true)), QString("lo"));
+    QCOMPARE(monitor.m_routes.count(), 1);
+
+    QCOMPARE(feed(&monitor, routeMessage(RTM_DELROUTE, 0, loopback, 0, true)), QString());
+    QCOMPARE(monitor.m_routes.count(), 0);
+}
+
+QByteArray UtRouteMonitor::ipv4Route(const char *iface, const char *destination, int flags,
+                                     int metric)
+{
+    return QString("%1\t%2\t0102A8C0\t%3\t0\t0\t%4\t%5\t0\t0\t0\n")
+        .arg(iface)
+        .arg(destination)
+        .arg(flags, 4, 16, QChar('0'))
+        .arg(metric)
+        .arg(qstrcmp(destination, AnyAddress) == 0 ? AnyAddress : "00FFFFFF")
+        .toLatin1();
+}
+
+QByteArray UtRouteMonitor::ipv6Route(const char *destination, int flags, int metric,
+                                     const char *iface)
+{
+    return QString("%1 00 00000000000000000000000000000000 00 "
+                   "fe800000000000000000000000000001 %2 00000001 00000000 %3 %4\n")
+        .arg(destination)
+        .arg(metric, 8, 16, QChar('0'))
+        .arg(flags, 8, 16, QChar('0'))
+        .arg(iface, 8)
+        .toLatin1();
+}
+
+QString UtRouteMonitor::scan(const QByteArray &ipv4Table, const QByteArray &ipv6Table)
+{
+    QTemporaryFile ipv4;
+    QTemporaryFile ipv6;
+    if (!ipv4.open() || !ipv6.open())
+        return QLatin1String("<no temporary file>");
+
+    ipv4.write(ipv4Table);
+    ipv4.flush();
+    ipv6.write(ipv6Table);
+    ipv6.flush();
+
+    return RouteMonitor::scanRouteTables(QFile::encodeName(ipv4.fileName()).constData(),
+                                         QFile::encodeName(ipv6.fileName()).constData());
+}
+
+// An IPv4 default route in the main table
+QByteArray UtRouteMonitor::routeMessage(int type, int flags, int index, quint32 metric,
+                                        bool multipath)
+{
+    QByteArray message(NLMSG_SPACE(sizeof(struct rtmsg)), '\0');
+
+    struct rtmsg *route = static_cast<struct rtmsg *>(
+            NLMSG_DATA(reinterpret_cast<struct nlmsghdr *>(message.data())));
+    route->rtm_family = AF_INET;
+    route->rtm_table = RT_TABLE_MAIN;
+    route->rtm_type = RTN_UNICAST;
+
+    appendAttribute(&message, RTA_PRIORITY, &metric, sizeof(metric));
+    if (multipath) {
+        struct rtnexthop nexthop;
+        memset(&nexthop, 0, sizeof(nexthop));
+        nexthop.rtnh_len = sizeof(nexthop);
+        nexthop.rtnh_ifindex = index;
+        appendAttribute(&message, RTA_MULTIPATH, &nexthop, sizeof(nexthop));
+    } else {
+        appendAttribute(&message, RTA_OIF, &index, sizeof(index));
+    }
+
+    struct nlmsghdr *header = reinterpret_cast<struct nlmsghdr *>(message.data());
+    header->nlmsg_len = message.size();
+    header->nlmsg_type = type;
+    header->nlmsg_flags = flags;
+    return message;
+}
+
+void UtRouteMonitor::appendAttribute(QByteArray *message, int type, const void *data,
+                                     int length)
+{
+    struct rtattr attribute;
+    attribute.rta_type = type;
+    attribute.rta_len = RTA_LENGTH(length);
+
+    const int start = message->size();
+    message->append(QByteArray(RTA_SPACE(length), '\0'));
+    memcpy(message->data() + start, &attribute, sizeof(attribute));
+    memcpy(message->data() + start + RTA_LENGTH(0), data, length);
+}
+
+// Leaves the monitor to the messages fed by hand
+void UtRouteMonitor::reset(RouteMonitor *monitor)
+{
+    monitor->closeSocket();
+    monitor->m_routes.clear();
+}
+
+QString UtRouteMonitor::feed(RouteMonitor *monitor, QByteArray messages)
+{
+    monitor->handleMessages(messages.data(), messages.size());
+    monitor->updateDefaultInterface();
+    return monitor->defaultInterface();
+}
+
+QTEST_MAIN(UtRouteMonitor)
+
+#include "ut_routemonitor.moc"
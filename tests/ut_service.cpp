@@ -1,6 +1,7 @@
 #include <QtCore/QPointer>
 
 #include "../libconnman-qt/networkservice.h"
+#include "../libconnman-qt/stringpool.h"
 #include "testbase.h"
 
 namespace Tests {
@@ -26,9 +27,14 @@ private slots:
     void testPropertiesAfterSetPath();
     void testPropertySpontaneousChange_data();
     void testPropertySpontaneousChange();
+    void testTypedProperties();
+    void testPropertyIds();
+    void testInterned();
+    void testCoalesceChanges();
     void testConnect();
     void testDisconnect();
     void testConnectFailure();
+    void testServiceState();
     void testRemove();
 
 private:
@@ -85,6 +91,8 @@ using namespace Tests;
  * \class Tests::UtService
  */
 
+Q_DECLARE_METATYPE(NetworkService::ServiceState) // needed by SignalSpy
+
 void UtService::initTestCase()
 {
     QVERIFY(waitForService("net.connman", "/", "net.connman.Manager"));
@@ -220,6 +228,117 @@ void UtService::testPropertySpontaneousChange()
     QCOMPARE(m_service->property(qtProperty), newValue);
 }
 
+void UtService::testTypedProperties()
+{
+    QDBusInterface service("net.connman", "/service0", "net.connman.Service", bus());
+
+    // Known properties are stored decoded, only the others are kept as they came
+    QVERIFY(m_service->m_knownProperties & (1u << NetworkService::StrengthProperty));
+    QCOMPARE(m_service->m_properties.strength, m_service->strength());
+    QCOMPARE(m_service->m_properties.ipv4, m_service->ipv4());
+    QVERIFY(!m_service->m_propertiesCache.contains("Strength"));
+    QVERIFY(!m_service->m_propertiesCache.contains("IPv4"));
+    QVERIFY(m_service->m_propertiesCache.contains("Immutable"));
+
+    const bool immutable = !m_service->m_propertiesCache.value("Immutable").toBool();
+    QDBusReply<void> reply = service.call("mock_setProperty", "Immutable",
+            QVariant::fromValue(QDBusVariant(immutable)));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    QTest::qWait(500);
+    QCOMPARE(m_service->m_propertiesCache.value("Immutable").toBool(), immutable);
+
+    reply = service.call("mock_setProperty", "Immutable", QVariant::fromValue(QDBusVariant(!immutable)));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    QTest::qWait(500);
+}
+
+void UtService::testPropertyIds()
+{
+    QCOMPARE(NetworkService::propertyId("Name"), int(NetworkService::NameProperty));
+    QCOMPARE(NetworkService::propertyId("Strength"), int(NetworkService::StrengthProperty));
+    QCOMPARE(NetworkService::propertyId("IPv4.Configuration"), int(NetworkService::IPv4ConfigProperty));
+    QCOMPARE(NetworkService::propertyId("Hidden"), int(NetworkService::HiddenProperty));
+
+    // Lookups are exact, anything else stays in the generic cache
+    QCOMPARE(NetworkService::propertyId("Immutable"), -1);
+    QCOMPARE(NetworkService::propertyId("name"), -1);
+    QCOMPARE(NetworkService::propertyId(QString()), -1);
+}
+
+void UtService::testInterned()
+{
+    // Both instances hold the same data, not just equal strings
+    QCOMPARE(m_service->path(), m_otherService->path());
+    QVERIFY(m_service->path().constData() == m_otherService->path().constData());
+    QVERIFY(!m_service->state().isEmpty());
+    QCOMPARE(m_service->state(), m_otherService->state());
+    QVERIFY(m_service->state().constData() == m_otherService->state().constData());
+
+    QCOMPARE(StringPool::state(QString("online")), StringPool::OnlineState);
+    QCOMPARE(StringPool::state(QString("idle")), StringPool::IdleState);
+    QCOMPARE(StringPool::state(QString("bogus")), StringPool::UnknownState);
+    QCOMPARE(StringPool::state(QString()), StringPool::UnknownState);
+
+    // Strings nobody holds on to are swept, the others stay as they are
+    const QString kept = StringPool::intern(QString("/kept"));
+    const int size = StringPool::size();
+    for (int i = 0; i < 1000; ++i)
+        StringPool::intern(QString("/transient%1").arg(i));
+    QVERIFY(StringPool::size() < size + 1000);
+    QVERIFY(StringPool::intern(QString("/kept")).constData() == kept.constData());
+    QVERIFY(StringPool::intern(m_service->path()).constData() == m_service->path().constData());
+}
+
+void UtService::testCoalesceChanges()
+{
+    QDBusInterface service("net.connman", "/service0", "net.connman.Service", bus());
+
+    m_service->setCoalesceInterval(500);
+    m_service->setCoalesceChanges(true);
+
+    SignalSpy strengthChangedSpy(m_service, SIGNAL(strengthChanged(uint)));
+    SignalSpy nameChangedSpy(m_service, SIGNAL(nameChanged(QString)));
+    SignalSpy propertiesChangedSpy(m_service, SIGNAL(propertiesChanged(QStringList)));
+
+    QDBusReply<void> reply = service.call("mock_setProperty", "Strength",
+            QVariant::fromValue(QDBusVariant(10)));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    reply = service.call("mock_setProperty", "Strength",
+            QVariant::fromValue(QDBusVariant(11)));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    reply = service.call("mock_setProperty", "Name",
+            QVariant::fromValue(QDBusVariant(QString("Coalesced"))));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    QVERIFY(waitForSignal(&propertiesChangedSpy));
+    QCOMPARE(propertiesChangedSpy.count(), 1);
+    const QStringList names = propertiesChangedSpy.at(0).at(0).toStringList();
+    QCOMPARE(names.count(), 2);
+    QVERIFY(names.contains("Strength"));
+    QVERIFY(names.contains("Name"));
+
+    QCOMPARE(strengthChangedSpy.count(), 1);
+    QCOMPARE(strengthChangedSpy.at(0).at(0).toUInt(), 11u);
+    QCOMPARE(nameChangedSpy.count(), 1);
+
+    // Stored right away, and turning it off flushes what is still pending
+    m_service->setCoalesceInterval(60000);
+    propertiesChangedSpy.clear();
+    strengthChangedSpy.clear();
+    reply = service.call("mock_setProperty", "Strength", QVariant::fromValue(QDBusVariant(12)));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    QTest::qWait(500);
+    QCOMPARE(m_service->strength(), 12u);
+    QCOMPARE(strengthChangedSpy.count(), 0);
+
+    m_service->setCoalesceChanges(false);
+    QCOMPARE(strengthChangedSpy.count(), 1);
+    QCOMPARE(propertiesChangedSpy.count(), 1);
+
+    m_service->setCoalesceInterval(0);
+}
+
 void UtService::testConnect()
 {
     SignalSpy stateChangedSpy(m_service, SIGNAL(stateChanged(QString)));
@@ -268,6 +387,39 @@ void UtService::testConnectFailure()
     QCOMPARE(m_service->state(), QString("failure"));
 }
 
+void UtService::testServiceState()
+{
+    QDBusInterface service("net.connman", "/service0", "net.connman.Service", bus());
+
+    qRegisterMetaType<NetworkService::ServiceState>("NetworkService::ServiceState");
+    SignalSpy serviceStateChangedSpy(m_service,
+            SIGNAL(serviceStateChanged(NetworkService::ServiceState)));
+
+    QCOMPARE(m_service->serviceState(), NetworkService::FailureState);
+
+    QDBusReply<void> reply = service.call("mock_setProperty", "State",
+            QVariant::fromValue(QDBusVariant(QString("ready"))));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    QVERIFY(waitForSignal(&serviceStateChangedSpy));
+    QCOMPARE(serviceStateChangedSpy.count(), 1);
+    QCOMPARE(serviceStateChangedSpy.at(0).at(0).value<NetworkService::ServiceState>(),
+             NetworkService::ReadyState);
+    QCOMPARE(m_service->serviceState(), NetworkService::ReadyState);
+    QCOMPARE(m_service->property("serviceState").toInt(), int(NetworkService::ReadyState));
+    QVERIFY(m_service->connected());
+
+    serviceStateChangedSpy.clear();
+    reply = service.call("mock_setProperty", "State",
+            QVariant::fromValue(QDBusVariant(QString("idle"))));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    QVERIFY(waitForSignal(&serviceStateChangedSpy));
+    QCOMPARE(serviceStateChangedSpy.count(), 1);
+    QCOMPARE(m_service->serviceState(), NetworkService::IdleState);
+    QVERIFY(!m_service->connected());
+}
+
 void UtService::testRemove()
 {
     QDBusInterface service("net.connman", "/service0", "net.connman.Service", bus());
@@ -32,8 +32,12 @@ private slots:
     void testSetPath();
     void testPropertiesAfterSetPath_data();
     void testPropertiesAfterSetPath();
+    void testQueuedRequests();
+    void testCreateSessionSuperseded();
 
 private:
+    static bool waitForSettings(SignalSpy *settingsUpdatedSpy, QVariantMap *settings,
+            const QString &name, const QVariant &value);
     QObject *findSessionNotificationAdaptor() const;
 
 private:
@@ -59,6 +63,12 @@ public:
             const QDBusObjectPath &notifier, const QDBusMessage &message);
     Q_SCRIPTABLE void DestroySession(const QDBusObjectPath &path, const QDBusMessage &message);
 
+    // mock API
+    Q_SCRIPTABLE void mock_temporarilyUnregister();
+    Q_SCRIPTABLE void mock_setHoldCreateSession(bool hold);
+    Q_SCRIPTABLE void mock_releaseCreateSession();
+    Q_SCRIPTABLE QStringList mock_sessions(const QString &notifierPath) const;
+
 signals:
     Q_SCRIPTABLE void PropertyChanged(const QString &name, const QVariant &value);
 
@@ -66,6 +76,8 @@ private:
     bool m_sessionMode;
     int m_sessionNextIndex;
     QMap<QString, SessionMock *> m_sessions;
+    bool m_holdCreateSession;
+    QList<QDBusMessage> m_heldCreateSessionReplies;
 };
 
 class UtSession::SessionMock : public QObject
@@ -253,6 +265,122 @@ void UtSession::testPropertiesAfterSetPath()
     QCOMPARE(m_session->property(QTest::currentDataTag()), expected);
 }
 
+void UtSession::testQueuedRequests()
+{
+    SessionAgent agent("/UtSessionQueuedAgent");
+
+    SignalSpy sessionCreatedSpy(&agent, SIGNAL(sessionCreated(QDBusObjectPath)));
+    SignalSpy settingsUpdatedSpy(&agent, SIGNAL(settingsUpdated(QVariantMap)));
+    SignalSpy pendingChangesSpy(&agent, SIGNAL(pendingChangesChanged(int)));
+    SignalSpy changeFailedSpy(&agent, SIGNAL(changeFailed(QString,QString)));
+
+    // The session is being created, requests wait for it and only the
+    // last value of a key is kept
+    QCOMPARE(sessionCreatedSpy.count(), 0);
+    agent.setConnectionType("internet");
+    agent.setConnectionType("local");
+    agent.requestConnect();
+    QCOMPARE(agent.pendingChanges(), 1);
+
+    QVERIFY(waitForSignal(&sessionCreatedSpy));
+
+    QVariantMap settings;
+    QVERIFY(waitForSettings(&settingsUpdatedSpy, &settings, "State", "connected"));
+    QVERIFY(waitForSettings(&settingsUpdatedSpy, &settings, "ConnectionType", "local"));
+
+    while (agent.pendingChanges() != 0) {
+        pendingChangesSpy.clear();
+        QVERIFY(waitForSignal(&pendingChangesSpy));
+    }
+
+    // One Change is on its way, newer values of the key wait behind it
+    pendingChangesSpy.clear();
+    agent.setConnectionType("any");
+    agent.setConnectionType("local");
+    agent.setConnectionType("internet");
+    QCOMPARE(agent.pendingChanges(), 2);
+    QCOMPARE(pendingChangesSpy.count(), 2);
+
+    while (agent.pendingChanges() != 0) {
+        pendingChangesSpy.clear();
+        QVERIFY(waitForSignal(&pendingChangesSpy));
+    }
+    QVERIFY(waitForSettings(&settingsUpdatedSpy, &settings, "ConnectionType", "internet"));
+    QCOMPARE(changeFailedSpy.count(), 0);
+
+    // Rejected by the mock
+    agent.setConnectionType("bogus");
+    QVERIFY(waitForSignal(&changeFailedSpy));
+    QCOMPARE(changeFailedSpy.at(0).at(0).toString(), QString("ConnectionType"));
+    QCOMPARE(agent.pendingChanges(), 0);
+
+    SignalSpy releasedSpy(&agent, SIGNAL(released()));
+    agent.requestDestroy();
+    QVERIFY(waitForSignal(&releasedSpy));
+}
+
+void UtSession::testCreateSessionSuperseded()
+{
+    QDBusInterface manager("net.connman", "/", "net.connman.Manager", bus());
+    const QString agentPath = "/UtSessionSupersededAgent";
+
+    QDBusReply<void> reply = manager.call("mock_setHoldCreateSession", true);
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    SessionAgent agent(agentPath);
+    SignalSpy sessionCreatedSpy(&agent, SIGNAL(sessionCreated(QDBusObjectPath)));
+    SignalSpy releasedSpy(&agent, SIGNAL(released()));
+
+    // connman goes away and comes back before the first reply, the agent
+    // asks again
+    SignalSpy availabilityChangedSpy(NetworkManagerFactory::createInstance(),
+            SIGNAL(availabilityChanged(bool)));
+    QDBusPendingReply<> unregisterReply = manager.asyncCall("mock_temporarilyUnregister");
+    QDBusPendingCallWatcher watcher(unregisterReply);
+    QVERIFY(waitForSignal(&watcher, SIGNAL(finished(QDBusPendingCallWatcher*))));
+    QCOMPARE(availabilityChangedSpy.count(), 2);
+
+    reply = manager.call("mock_setHoldCreateSession", false);
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    reply = manager.call("mock_releaseCreateSession");
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+
+    // Only the second one is adopted, the first is destroyed
+    QVERIFY(waitForSignal(&sessionCreatedSpy));
+    QVERIFY(waitForSignal(&releasedSpy));
+    QCOMPARE(sessionCreatedSpy.count(), 1);
+
+    QDBusReply<QStringList> sessions = manager.call("mock_sessions", agentPath);
+    QVERIFY2(sessions.isValid(), qPrintable(sessions.error().message()));
+    QCOMPARE(sessions.value(), QStringList()
+            << sessionCreatedSpy.at(0).at(0).value<QDBusObjectPath>().path());
+
+    releasedSpy.clear();
+    agent.requestDestroy();
+    QVERIFY(waitForSignal(&releasedSpy));
+}
+
+// Collects the updates until name has value
+bool UtSession::waitForSettings(SignalSpy *settingsUpdatedSpy, QVariantMap *settings,
+        const QString &name, const QVariant &value)
+{
+    while (settings->value(name) != value) {
+        if (!waitForSignal(settingsUpdatedSpy))
+            return false;
+
+        Q_FOREACH (const QList<QVariant> &arguments, *settingsUpdatedSpy) {
+            const QVariantMap updated = arguments.at(0).toMap();
+            QMapIterator<QString, QVariant> it(updated);
+            while (it.hasNext()) {
+                it.next();
+                settings->insert(it.key(), it.value());
+            }
+        }
+        settingsUpdatedSpy->clear();
+    }
+    return true;
+}
+
 QObject *UtSession::findSessionNotificationAdaptor() const
 {
     QObject *sessionNotificationAdaptor = 0;
@@ -273,7 +401,8 @@ QObject *UtSession::findSessionNotificationAdaptor() const
 UtSession::ManagerMock::ManagerMock()
     : MainObjectMock("net.connman", "/"),
       m_sessionMode(false),
-      m_sessionNextIndex(0)
+      m_sessionNextIndex(0),
+      m_holdCreateSession(false)
 {
 }
 
@@ -335,6 +464,14 @@ QDBusObjectPath UtSession::ManagerMock::CreateSession(const QVariantMap &setting
     }
 
     m_sessions[path] = session;
+
+    if (m_holdCreateSession) {
+        message.setDelayedReply(true);
+        m_heldCreateSessionReplies.append(
+                message.createReply(QVariant::fromValue(QDBusObjectPath(path))));
+        return QDBusObjectPath();
+    }
+
     return QDBusObjectPath(path);
 }
 
@@ -363,6 +500,39 @@ void UtSession::ManagerMock::DestroySession(const QDBusObjectPath &path, const Q
     session->deleteLater();
 }
 
+void UtSession::ManagerMock::mock_temporarilyUnregister()
+{
+    bus().unregisterService("net.connman");
+
+    if (!bus().registerService("net.connman")) {
+        qWarning("%s: Failed to re-register service", Q_FUNC_INFO);
+    }
+}
+
+void UtSession::ManagerMock::mock_setHoldCreateSession(bool hold)
+{
+    m_holdCreateSession = hold;
+}
+
+void UtSession::ManagerMock::mock_releaseCreateSession()
+{
+    Q_FOREACH (const QDBusMessage &reply, m_heldCreateSessionReplies)
+        bus().send(reply);
+    m_heldCreateSessionReplies.clear();
+}
+
+QStringList UtSession::ManagerMock::mock_sessions(const QString &notifierPath) const
+{
+    QStringList sessions;
+    QMapIterator<QString, SessionMock *> it(m_sessions);
+    while (it.hasNext()) {
+        it.next();
+        if (it.value()->notifierPath() == notifierPath)
+            sessions.append(it.key());
+    }
+    return sessions;
+}
+
 /*
  * \class Tests::UtSession::SessionMock
  */
@@ -422,6 +592,12 @@ void UtSession::SessionMock::Destroy(const QDBusMessage &message)
 void UtSession::SessionMock::Change(const QString &name, const QDBusVariant &value,
         const QDBusMessage &message)
 {
+    if (value.variant() == QVariant("bogus")) {
+        const QString err = QString("Invalid value for '%1'").arg(name);
+        bus().send(message.createErrorReply(QDBusError::InvalidArgs, err));
+        return;
+    }
+
     m_settings[name] = value.variant();
 
     bus().send(message.createReply());
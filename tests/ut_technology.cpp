@@ -19,9 +19,13 @@ private slots:
 
     void testProperties_data();
     void testProperties();
+    void testPropertyIds();
     void testWriteProperties_data();
     void testWriteProperties();
     void testScan();
+    void testScanReusesRecentResults();
+    void testScanIntervalWithoutManager();
+    void testScanMetrics();
     void testSetPath();
     void testPropertiesAfterSetPath_data();
     void testPropertiesAfterSetPath();
@@ -56,11 +60,15 @@ public:
         const QDBusMessage &message);
     Q_SCRIPTABLE void Scan();
 
+    // mock API
+    Q_SCRIPTABLE int mock_scanCount() const;
+
 signals:
     Q_SCRIPTABLE void PropertyChanged(const QString &name, const QDBusVariant &value);
 
 private:
     QVariantMap m_properties;
+    int m_scanCount;
 };
 
 } // namespace Tests
@@ -99,6 +107,18 @@ void UtTechnology::testProperties()
     testProperty(*m_technology, QTest::currentDataTag(), expected);
 }
 
+void UtTechnology::testPropertyIds()
+{
+    QCOMPARE(NetworkTechnology::propertyId("Powered"), int(NetworkTechnology::PoweredProperty));
+    QCOMPARE(NetworkTechnology::propertyId("IdleTimeout"), int(NetworkTechnology::IdleTimeoutProperty));
+    QCOMPARE(NetworkTechnology::propertyId("TetheringIdentifier"),
+            int(NetworkTechnology::TetheringIdentifierProperty));
+    QCOMPARE(NetworkTechnology::propertyId("Tethering"), int(NetworkTechnology::TetheringProperty));
+
+    QCOMPARE(NetworkTechnology::propertyId("powered"), -1);
+    QCOMPARE(NetworkTechnology::propertyId("Unknown"), -1);
+}
+
 void UtTechnology::testWriteProperties_data()
 {
     QTest::addColumn<QVariant>("newValue");
@@ -124,6 +144,83 @@ void UtTechnology::testScan()
     QVERIFY(waitForSignal(m_technology, SIGNAL(scanFinished())));
 }
 
+void UtTechnology::testScanReusesRecentResults()
+{
+    m_technology->scan();
+    QVERIFY(waitForSignal(m_technology, SIGNAL(scanFinished())));
+
+    QDBusInterface technology("net.connman", "/technology0", "net.connman.Technology", bus());
+
+    QDBusReply<int> scanCount = technology.call("mock_scanCount");
+    QVERIFY(scanCount.isValid());
+    const int scansBefore = scanCount.value();
+    QVERIFY(scansBefore > 0);
+
+    // Both requests are answered by the scan that just finished
+    SignalSpy scanFinishedSpy(m_technology, SIGNAL(scanFinished()));
+    m_technology->scan();
+    m_technology->scan();
+    QVERIFY(waitForSignal(&scanFinishedSpy));
+    QCOMPARE(scanFinishedSpy.count(), 1);
+
+    scanCount = technology.call("mock_scanCount");
+    QVERIFY(scanCount.isValid());
+    QCOMPARE(scanCount.value(), scansBefore);
+}
+
+void UtTechnology::testScanIntervalWithoutManager()
+{
+    QDBusInterface technology("net.connman", "/technology0", "net.connman.Technology", bus());
+
+    m_technology->scan();
+    QVERIFY(waitForSignal(m_technology, SIGNAL(scanFinished())));
+
+    QDBusReply<int> scanCount = technology.call("mock_scanCount");
+    QVERIFY(scanCount.isValid());
+    const int scansBefore = scanCount.value();
+
+    // Not hearing of service changes it does not back off
+    for (int i = 1; i <= 2; ++i) {
+        QTest::qWait(2100);
+        m_technology->scan();
+        QVERIFY(waitForSignal(m_technology, SIGNAL(scanFinished())));
+
+        scanCount = technology.call("mock_scanCount");
+        QVERIFY(scanCount.isValid());
+        QCOMPARE(scanCount.value(), scansBefore + i);
+    }
+}
+
+void UtTechnology::testScanMetrics()
+{
+    QCOMPARE(m_otherTechnology->scanMetrics(), QVariantMap());
+
+    m_otherTechnology->setScanMetricsEnabled(true);
+    QVERIFY(m_otherTechnology->scanMetricsEnabled());
+
+    SignalSpy scanMeasuredSpy(m_otherTechnology, SIGNAL(scanMeasured(QVariantMap)));
+    m_otherTechnology->scan();
+    QVERIFY(waitForSignal(&scanMeasuredSpy));
+
+    const QVariantMap record = scanMeasuredSpy.at(0).at(0).toMap();
+    QCOMPARE(record.value("error").toString(), QString());
+    QVERIFY(record.value("latency").toInt() >= 0);
+
+    const QVariantMap metrics = m_otherTechnology->scanMetrics();
+    QCOMPARE(metrics.value("scans").toInt(), 1);
+    QCOMPARE(metrics.value("errors").toInt(), 0);
+
+    int histogramTotal = 0;
+    Q_FOREACH (const QVariant &count, metrics.value("latencyHistogram").toList())
+        histogramTotal += count.toInt();
+    QCOMPARE(histogramTotal, 1);
+    QCOMPARE(metrics.value("latencyHistogram").toList().count(),
+            metrics.value("latencyBounds").toList().count() + 1);
+
+    m_otherTechnology->setScanMetricsEnabled(false);
+    QCOMPARE(m_otherTechnology->scanMetrics(), QVariantMap());
+}
+
 void UtTechnology::testSetPath()
 {
     m_technology->setPath("/technology1");
@@ -173,7 +270,8 @@ UtTechnology::ManagerMock::ManagerMock()
 
 UtTechnology::TechnologyMock::TechnologyMock(const QVariantMap &properties, ManagerMock *manager)
     : QObject(manager),
-      m_properties(properties)
+      m_properties(properties),
+      m_scanCount(0)
 {
 }
 
@@ -206,7 +304,12 @@ void UtTechnology::TechnologyMock::SetProperty(const QString &name, const QDBusV
 
 void UtTechnology::TechnologyMock::Scan()
 {
-    // noop
+    ++m_scanCount;
+}
+
+int UtTechnology::TechnologyMock::mock_scanCount() const
+{
+    return m_scanCount;
 }
 
 TEST_MAIN_WITH_MOCK(UtTechnology, UtTechnology::ManagerMock)
@@ -0,0 +1,384 @@
+#include <QtCore/QDir>
+
+#include "../libconnman-qt/counter.h"
+#include "../libconnman-qt/counteraggregator.h"
+#include "../libconnman-qt/usagestore.h"
+#include "testbase.h"
+
+namespace Tests {
+
+class UtUsageStore : public TestBase
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testAppend();
+    void testMissingValues();
+    void testReopen();
+    void testSecondStoreReads();
+    void testCompaction();
+    void testExpiredServices();
+    void testWriterRole();
+    void testStartOver();
+    void testCounterDestroyed();
+    void testAggregatorLoad();
+
+private:
+    QString m_fileName;
+};
+
+} // namespace Tests
+
+using namespace Tests;
+using namespace Tests::UsageFixtures;
+
+/*
+ * \class Tests::UtUsageStore
+ */
+
+void UtUsageStore::init()
+{
+    m_fileName = QString("%1/ut_usagestore-%2").arg(QDir::tempPath())
+        .arg(QCoreApplication::applicationPid());
+    QFile::remove(m_fileName);
+}
+
+void UtUsageStore::cleanup()
+{
+    QFile::remove(m_fileName);
+    QFile::remove(m_fileName + ".new");
+    QFile::remove(m_fileName + ".bad");
+}
+
+void UtUsageStore::testAppend()
+{
+    Counter counter;
+    UsageStore store;
+    store.setCounter(&counter);
+    store.setFileName(m_fileName);
+    QVERIFY(store.isOpen());
+    QVERIFY(store.isWritable());
+    QCOMPARE(store.count(), 0);
+
+    SignalSpy countChangedSpy(&store, SIGNAL(countChanged(int)));
+
+    store.append(Wifi, counters(100, 10, 1), false, 1000);
+    store.append(Wifi, counters(200, 20, 2), false, 2000);
+    store.append(Cellular, counters(50, 5, 1), true, 3000);
+
+    QCOMPARE(countChangedSpy.count(), 3);
+    QCOMPARE(store.count(), 3);
+    QCOMPARE(store.services(), QStringList() << Wifi << Cellular);
+
+    const UsageStore::Sample sample = store.sample(2);
+    QCOMPARE(sample.servicePath, Cellular);
+    QCOMPARE(sample.timestamp, Q_INT64_C(3000));
+    QCOMPARE(sample.rxBytes, Q_UINT64_C(50));
+    QCOMPARE(sample.txBytes, Q_UINT64_C(5));
+    QCOMPARE(sample.seconds, 1u);
+    QVERIFY(sample.roaming);
+
+    QCOMPARE(store.latest(Wifi, false), counters(200, 20, 2));
+    QCOMPARE(store.latest(Wifi, true), QVariantMap());
+    QCOMPARE(store.latest(Cellular, true), counters(50, 5, 1));
+}
+
+void UtUsageStore::testMissingValues()
+{
+    Counter counter;
+    UsageStore store;
+    store.setCounter(&counter);
+    store.setFileName(m_fileName);
+
+    store.append(Wifi, counters(100, 10, 1), false, 1000);
+
+    QVariantMap changed;
+    changed.insert("TX.Bytes", Q_UINT64_C(30));
+    store.append(Wifi, changed, false, 2000);
+
+    QCOMPARE(store.latest(Wifi, false), counters(100, 30, 1));
+}
+
+void UtUsageStore::testReopen()
+{
+    Counter counter;
+    UsageStore *store = new UsageStore;
+    store->setCounter(&counter);
+    store->setFileName(m_fileName);
+    store->append(Wifi, counters(100, 10, 1), false, 1000);
+    store->append(Wifi, counters(200, 20, 2), false, 2000);
+    delete store;
+
+    UsageStore reopened;
+    reopened.setCounter(&counter);
+    reopened.setFileName(m_fileName);
+    QVERIFY(reopened.isWritable());
+    QCOMPARE(reopened.count(), 2);
+    QCOMPARE(reopened.sample(0).servicePath, Wifi);
+    QCOMPARE(reopened.sample(1).rxBytes, Q_UINT64_C(200));
+    QCOMPARE(reopened.latest(Wifi, false), counters(200, 20, 2));
+
+    reopened.append(Wifi, counters(300, 30, 3), false, 3000);
+    QCOMPARE(reopened.count(), 3);
+}
+
+void UtUsageStore::testSecondStoreReads()
+{
+    Counter counter;
+    UsageStore writer;
+    writer.setCounter(&counter);
+    writer.setFileName(m_fileName);
+    writer.append(Wifi, counters(100, 10, 1), false, 1000);
+
+    UsageStore reader;
+    reader.setFileName(m_fileName);
+    QVERIFY(reader.isOpen());
+    QVERIFY(!reader.isWritable());
+    QCOMPARE(reader.count(), 1);
+
+    reader.append(Wifi, counters(200, 20, 2), false, 2000);
+    QCOMPARE(writer.count(), 1);
+
+    SignalSpy countChangedSpy(&reader, SIGNAL(countChanged(int)));
+
+    writer.append(Wifi, counters(300, 30, 3), false, 3000);
+    QCOMPARE(reader.count(), 1);
+
+    QVERIFY(reader.refresh());
+    QCOMPARE(countChangedSpy.count(), 1);
+    QCOMPARE(reader.count(), 2);
+    QCOMPARE(reader.latest(Wifi, false), counters(300, 30, 3));
+    QVERIFY(!reader.refresh());
+}
+
+void UtUsageStore::testCompaction()
+{
+    Counter counter;
+    UsageStore writer;
+    writer.setCounter(&counter);
+    writer.setFileName(m_fileName);
+
+    UsageStore reader;
+    reader.setFileName(m_fileName);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    quint64 rx = 0;
+
+    // Beyond the retention only the last one stays, as the baseline
+    const qint64 expired = (now - 100 * Day) / Day * Day;
+    writer.append(Wifi, counters(rx += 1000, 0, 0), false, expired);
+    writer.append(Wifi, counters(rx += 1000, 0, 0), false, expired + Hour);
+
+    // One per day
+    const qint64 day = (now - 10 * Day) / Day * Day;
+    for (int i = 0; i < 24; ++i)
+        writer.append(Wifi, counters(rx += 1000, 0, 0), false, day + i * Hour);
+
+    // One per minute, and the last one before the counters were reset
+    const qint64 minute = (now - 10 * Minute) / Minute * Minute;
+    for (int i = 0; i < 10; ++i) {
+        if (i == 5)
+            rx = 0;
+        writer.append(Wifi, counters(rx += 1000, 0, 0), false, minute + i * Second);
+    }
+
+    writer.append(Cellular, counters(100, 0, 0), true, minute);
+
+    QCOMPARE(writer.count(), 37);
+    const QVariantMap latest = writer.latest(Wifi, false);
+
+    QVERIFY(writer.compact());
+    QCOMPARE(writer.count(), 5);
+    QCOMPARE(writer.latest(Wifi, false), latest);
+    QCOMPARE(writer.latest(Cellular, true), counters(100, 0, 0));
+
+    QCOMPARE(writer.sample(0).timestamp, expired + Hour);
+    QCOMPARE(writer.sample(1).timestamp, day + 23 * Hour);
+    QCOMPARE(writer.sample(2).timestamp, minute + 4 * Second);
+    QCOMPARE(writer.sample(3).timestamp, minute + 9 * Second);
+
+    // The reader still has the replaced file until it refreshes
+    QCOMPARE(reader.count(), 37);
+    QVERIFY(reader.refresh());
+    QCOMPARE(reader.count(), 5);
+    QVERIFY(!reader.isWritable());
+
+    writer.append(Wifi, counters(rx += 1000, 0, 0), false, now);
+    QVERIFY(reader.refresh());
+    QCOMPARE(reader.count(), 6);
+}
+
+void UtUsageStore::testExpiredServices()
+{
+    Counter counter;
+    UsageStore writer;
+    writer.setCounter(&counter);
+    writer.setFileName(m_fileName);
+
+    UsageStore reader;
+    reader.setFileName(m_fileName);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    // Every slot taken, one by a service not seen within the retention
+    writer.append(Cellular, counters(100, 0, 0), false, now - 100 * Day);
+    for (int i = 1; i < 128; ++i) {
+        writer.append(QString("/net/connman/service/ethernet_%1_cable").arg(i),
+                counters(100, 0, 0), false, now);
+    }
+    QCOMPARE(writer.count(), 128);
+
+    // It gives up its slot to a new service
+    writer.append(Wifi, counters(100, 0, 0), false, now);
+    QCOMPARE(writer.count(), 128);
+    QCOMPARE(writer.services().count(), 128);
+    QVERIFY(!writer.services().contains(Cellular));
+    QCOMPARE(writer.latest(Wifi, false), counters(100, 0, 0));
+    QVERIFY(reader.refresh());
+
+    // With nothing to free the sample is dropped, without compacting
+    QTest::ignoreMessage(QtWarningMsg, "UsageStore: too many services");
+    writer.append(Cellular, counters(200, 0, 0), false, now);
+    QCOMPARE(writer.count(), 128);
+    QVERIFY(!writer.services().contains(Cellular));
+    QVERIFY(!reader.refresh());
+}
+
+void UtUsageStore::testWriterRole()
+{
+    Counter counter;
+    UsageStore *writer = new UsageStore;
+    writer->setCounter(&counter);
+    writer->setFileName(m_fileName);
+    writer->append(Wifi, counters(100, 10, 1), false, 1000);
+    delete writer;
+
+    // Without a counter a store only reads, even with the lock free
+    UsageStore viewer;
+    viewer.setFileName(m_fileName);
+    QVERIFY(viewer.isOpen());
+    QVERIFY(!viewer.isWritable());
+
+    writer = new UsageStore;
+    writer->setFileName(m_fileName);
+    QVERIFY(!writer->isWritable());
+    writer->setCounter(&counter);
+    QVERIFY(writer->isWritable());
+
+    Counter otherCounter;
+    UsageStore other;
+    other.setCounter(&otherCounter);
+    other.setFileName(m_fileName);
+    QVERIFY(!other.isWritable());
+    QCOMPARE(other.count(), 1);
+
+    // Appending is taken over once the writer is gone
+    delete writer;
+    SignalSpy writableChangedSpy(&other, SIGNAL(writableChanged(bool)));
+    QVERIFY(other.refresh());
+    QCOMPARE(writableChangedSpy.count(), 1);
+    QVERIFY(other.isWritable());
+
+    other.append(Wifi, counters(200, 20, 2), false, 2000);
+    QVERIFY(viewer.refresh());
+    QCOMPARE(viewer.count(), 2);
+
+    // Detaching the counter gives the lock up
+    other.setCounter(0);
+    QCOMPARE(writableChangedSpy.count(), 2);
+    QVERIFY(!other.isWritable());
+}
+
+void UtUsageStore::testStartOver()
+{
+    const QByteArray garbage(8192, 'x');
+    QFile file(m_fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(garbage);
+    file.close();
+
+    UsageStore viewer;
+    viewer.setFileName(m_fileName);
+    QVERIFY(!viewer.isOpen());
+
+    // The writer keeps the file aside and starts a new one
+    Counter counter;
+    UsageStore writer;
+    writer.setCounter(&counter);
+    writer.setFileName(m_fileName);
+    QVERIFY(writer.isWritable());
+    QCOMPARE(writer.count(), 0);
+
+    QFile bad(m_fileName + ".bad");
+    QVERIFY(bad.open(QIODevice::ReadOnly));
+    QCOMPARE(bad.readAll(), garbage);
+
+    writer.append(Wifi, counters(100, 10, 1), false, 1000);
+    QCOMPARE(writer.count(), 1);
+
+    QVERIFY(viewer.refresh());
+    QCOMPARE(viewer.count(), 1);
+
+    // Too short to hold anything, it is simply started over
+    writer.setCounter(0);
+    QFile::remove(m_fileName);
+    QFile::remove(m_fileName + ".bad");
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("CUSG");
+    file.close();
+
+    writer.setCounter(&counter);
+    QVERIFY(writer.isWritable());
+    QCOMPARE(writer.count(), 0);
+    QVERIFY(!QFile::exists(m_fileName + ".bad"));
+}
+
+void UtUsageStore::testCounterDestroyed()
+{
+    Counter *counter = new Counter;
+    UsageStore store;
+    store.setCounter(counter);
+    store.setFileName(m_fileName);
+    QVERIFY(store.isWritable());
+
+    CounterAggregator aggregator;
+    aggregator.setCounter(counter);
+
+    delete counter;
+    QVERIFY(store.counter() == 0);
+    QVERIFY(aggregator.counter() == 0);
+
+    Counter other;
+    store.setCounter(&other);
+    aggregator.setCounter(&other);
+    QVERIFY(store.isWritable());
+    QVERIFY(aggregator.counter() == &other);
+}
+
+void UtUsageStore::testAggregatorLoad()
+{
+    Counter counter;
+    UsageStore store;
+    store.setCounter(&counter);
+    store.setFileName(m_fileName);
+    store.append(Wifi, counters(1000, 100, 10), false, Start);
+    store.append(Wifi, counters(3000, 300, 20), false, Start + Minute);
+    store.append(Wifi, counters(3500, 300, 25), false, Start + 2 * Minute);
+
+    CounterAggregator aggregator;
+    aggregator.load(&store);
+
+    QCOMPARE(aggregator.services(), QStringList() << Wifi);
+    const QVariantMap total = aggregator.usage(Wifi, QDateTime::fromMSecsSinceEpoch(Start),
+            QDateTime::fromMSecsSinceEpoch(Start + Hour));
+    QCOMPARE(total.value("RX.Bytes").toULongLong(), Q_UINT64_C(2500));
+    QCOMPARE(total.value("TX.Bytes").toULongLong(), Q_UINT64_C(200));
+    QCOMPARE(total.value("Time").toULongLong(), Q_UINT64_C(15));
+}
+
+QTEST_MAIN(UtUsageStore)
+
+#include "ut_usagestore.moc"